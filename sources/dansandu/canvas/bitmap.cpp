@@ -1,15 +1,50 @@
 #include "dansandu/canvas/bitmap.hpp"
 #include "dansandu/ballotin/exception.hpp"
-#include "dansandu/ballotin/file_system.hpp"
+#include "dansandu/ballotin/logging.hpp"
 #include "dansandu/canvas/color.hpp"
 #include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/sink.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DANSANDU_CANVAS_BITMAP_X86
+#include <immintrin.h>
+#endif
+
+// GCC and Clang compile the vectorized paths for their instruction sets regardless of the build flags and pick them at
+// run time, while other compilers only take the paths the build already targets.
+#if defined(__GNUC__)
+#define DANSANDU_CANVAS_BITMAP_TARGET(instructions) __attribute__((target(instructions)))
+#else
+#define DANSANDU_CANVAS_BITMAP_TARGET(instructions)
+#endif
 
-using dansandu::ballotin::file_system::readBinaryFile;
-using dansandu::ballotin::file_system::writeBinaryFile;
 using dansandu::canvas::color::Color;
+using dansandu::canvas::color::Colors;
 using dansandu::canvas::image::Image;
+using dansandu::canvas::sink::ByteSink;
+using dansandu::canvas::sink::FileSink;
+using dansandu::canvas::sink::SinkBuffer;
 
 namespace dansandu::canvas::bitmap
 {
@@ -25,6 +60,267 @@ static constexpr auto pixelArrayByteOffset = 54;
 static constexpr auto rowRoundUpByteCount = 4;
 static constexpr auto colorPlanesCount = 1;
 static constexpr auto maximumDimension = 1048576U;
+static constexpr auto fileHeaderByteCount = 14;
+static constexpr auto v4HeaderByteCount = 108;
+static constexpr auto v5HeaderByteCount = 124;
+static constexpr auto uncompressed = 0;
+static constexpr auto rle8Compression = 1;
+static constexpr auto rle4Compression = 2;
+static constexpr auto bitfieldsCompression = 3;
+static constexpr auto redMask = 0x00FF0000U;
+static constexpr auto greenMask = 0x0000FF00U;
+static constexpr auto blueMask = 0x000000FFU;
+static constexpr auto alphaMask = 0xFF000000U;
+static constexpr auto maximumPaletteSize = 256;
+static constexpr auto endOfLine = 0;
+static constexpr auto endOfBitmap = 1;
+static constexpr auto delta = 2;
+
+static_assert(sizeof(Color) == 4, "colors must be stored as four consecutive red, green, blue and alpha bytes");
+
+static void convertRgbaRowToBgr(const uint8_t* rgba, uint8_t* bgr, const int width)
+{
+    for (auto w = 0; w < width; ++w, rgba += 4, bgr += 3)
+    {
+        bgr[0] = rgba[2];
+        bgr[1] = rgba[1];
+        bgr[2] = rgba[0];
+    }
+}
+
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+
+// Every store writes four bytes past the twelve converted ones, so the last few pixels are left to the scalar loop
+// rather than writing outside the row.
+DANSANDU_CANVAS_BITMAP_TARGET("ssse3")
+static void convertRgbaRowToBgrSsse3(const uint8_t* rgba, uint8_t* bgr, const int width)
+{
+    const auto shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    auto w = 0;
+    for (; w + 6 <= width; w += 4)
+    {
+        const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 4 * w));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgr + 3 * w), _mm_shuffle_epi8(pixels, shuffle));
+    }
+    convertRgbaRowToBgr(rgba + 4 * w, bgr + 3 * w, width - w);
+}
+
+// The shuffle packs each half into its low twelve bytes and the permutation joins the two halves, which leaves eight
+// spare bytes at the end of every store.
+DANSANDU_CANVAS_BITMAP_TARGET("avx2")
+static void convertRgbaRowToBgrAvx2(const uint8_t* rgba, uint8_t* bgr, const int width)
+{
+    const auto shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                          10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const auto permutation = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    auto w = 0;
+    for (; w + 11 <= width; w += 8)
+    {
+        const auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + 4 * w));
+        const auto packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, shuffle), permutation);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgr + 3 * w), packed);
+    }
+    convertRgbaRowToBgr(rgba + 4 * w, bgr + 3 * w, width - w);
+}
+
+#endif
+
+static void convertBgrRowToRgba(const uint8_t* bgr, uint8_t* rgba, const int width)
+{
+    for (auto w = 0; w < width; ++w, bgr += 3, rgba += 4)
+    {
+        rgba[0] = bgr[2];
+        rgba[1] = bgr[1];
+        rgba[2] = bgr[0];
+        rgba[3] = Color::channelDepth;
+    }
+}
+
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+
+// Every load reads four bytes past the twelve converted ones, which stay inside the pixel array as long as the scalar
+// loop takes the last few pixels.
+DANSANDU_CANVAS_BITMAP_TARGET("ssse3")
+static void convertBgrRowToRgbaSsse3(const uint8_t* bgr, uint8_t* rgba, const int width)
+{
+    const auto shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const auto alpha = _mm_set1_epi32(static_cast<int>(0xFF000000U));
+
+    auto w = 0;
+    for (; w + 6 <= width; w += 4)
+    {
+        const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr + 3 * w));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 4 * w),
+                         _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    convertBgrRowToRgba(bgr + 3 * w, rgba + 4 * w, width - w);
+}
+
+// The permutation moves the second twelve bytes into the upper half, where the shuffle can reach them.
+DANSANDU_CANVAS_BITMAP_TARGET("avx2")
+static void convertBgrRowToRgbaAvx2(const uint8_t* bgr, uint8_t* rgba, const int width)
+{
+    const auto permutation = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const auto shuffle = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3,
+                                          -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const auto alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000U));
+
+    auto w = 0;
+    for (; w + 11 <= width; w += 8)
+    {
+        const auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgr + 3 * w));
+        const auto spread = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(pixels, permutation), shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4 * w), _mm256_or_si256(spread, alpha));
+    }
+    convertBgrRowToRgba(bgr + 3 * w, rgba + 4 * w, width - w);
+}
+
+#endif
+
+// Reorders blue, green, red and alpha bytes, keeping the alpha byte or making every pixel opaque when the bitmap
+// stores no alpha in it.
+template<bool keepAlpha>
+static void convertBgraRowToRgba(const uint8_t* bgra, uint8_t* rgba, const int width)
+{
+    for (auto w = 0; w < width; ++w, bgra += 4, rgba += 4)
+    {
+        rgba[0] = bgra[2];
+        rgba[1] = bgra[1];
+        rgba[2] = bgra[0];
+        rgba[3] = keepAlpha ? bgra[3] : Color::channelDepth;
+    }
+}
+
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+
+template<bool keepAlpha>
+DANSANDU_CANVAS_BITMAP_TARGET("ssse3")
+static void convertBgraRowToRgbaSsse3(const uint8_t* bgra, uint8_t* rgba, const int width)
+{
+    const auto shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const auto alpha = _mm_set1_epi32(keepAlpha ? 0 : static_cast<int>(0xFF000000U));
+
+    auto w = 0;
+    for (; w + 4 <= width; w += 4)
+    {
+        const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgra + 4 * w));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 4 * w),
+                         _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    convertBgraRowToRgba<keepAlpha>(bgra + 4 * w, rgba + 4 * w, width - w);
+}
+
+template<bool keepAlpha>
+DANSANDU_CANVAS_BITMAP_TARGET("avx2")
+static void convertBgraRowToRgbaAvx2(const uint8_t* bgra, uint8_t* rgba, const int width)
+{
+    const auto shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7,
+                                          10, 9, 8, 11, 14, 13, 12, 15);
+    const auto alpha = _mm256_set1_epi32(keepAlpha ? 0 : static_cast<int>(0xFF000000U));
+
+    auto w = 0;
+    for (; w + 8 <= width; w += 8)
+    {
+        const auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgra + 4 * w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4 * w),
+                            _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+    }
+    convertBgraRowToRgba<keepAlpha>(bgra + 4 * w, rgba + 4 * w, width - w);
+}
+
+#endif
+
+// Pixels are packed from the high bits of each byte, and the palette always has an entry for every index the bits
+// can hold.
+template<int bits>
+static void convertIndexedRowToRgba(const uint8_t* indexes, Color* colors, const int width, const Color* palette)
+{
+    constexpr auto pixelsPerByte = bitsPerByte / bits;
+    constexpr auto mask = (1 << bits) - 1;
+
+    for (auto w = 0; w < width; ++w)
+    {
+        const auto shift = bitsPerByte - bits * (w % pixelsPerByte + 1);
+        colors[w] = palette[(indexes[w / pixelsPerByte] >> shift) & mask];
+    }
+}
+
+enum class Instructions
+{
+    Scalar,
+    Ssse3,
+    Avx2
+};
+
+static Instructions getSupportedInstructions()
+{
+#if defined(DANSANDU_CANVAS_BITMAP_X86) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Instructions::Avx2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        return Instructions::Ssse3;
+    }
+#elif defined(DANSANDU_CANVAS_BITMAP_X86) && defined(__AVX2__)
+    return Instructions::Avx2;
+#endif
+    return Instructions::Scalar;
+}
+
+using RowConverter = void (*)(const uint8_t*, uint8_t*, int);
+
+static RowConverter getRgbaRowToBgrConverter()
+{
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+    switch (getSupportedInstructions())
+    {
+    case Instructions::Avx2:
+        return convertRgbaRowToBgrAvx2;
+    case Instructions::Ssse3:
+        return convertRgbaRowToBgrSsse3;
+    default:
+        break;
+    }
+#endif
+    return convertRgbaRowToBgr;
+}
+
+template<bool keepAlpha>
+static RowConverter getBgraRowToRgbaConverter()
+{
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+    switch (getSupportedInstructions())
+    {
+    case Instructions::Avx2:
+        return convertBgraRowToRgbaAvx2<keepAlpha>;
+    case Instructions::Ssse3:
+        return convertBgraRowToRgbaSsse3<keepAlpha>;
+    default:
+        break;
+    }
+#endif
+    return convertBgraRowToRgba<keepAlpha>;
+}
+
+static RowConverter getBgrRowToRgbaConverter()
+{
+#ifdef DANSANDU_CANVAS_BITMAP_X86
+    switch (getSupportedInstructions())
+    {
+    case Instructions::Avx2:
+        return convertBgrRowToRgbaAvx2;
+    case Instructions::Ssse3:
+        return convertBgrRowToRgbaSsse3;
+    default:
+        break;
+    }
+#endif
+    return convertBgrRowToRgba;
+}
 
 static int getPixelArrayPaddingBitCount(const int width)
 {
@@ -39,65 +335,326 @@ static int getPixelArrayPaddingByteCount(const int width)
     return getPixelArrayPaddingBitCount(width) / bitsPerByte;
 }
 
-static int getPixelArrayByteCount(const int width, const int height)
+static int getRowByteCount(const int width)
 {
-    const auto rowPaddingBitCount = getPixelArrayPaddingBitCount(width);
-    const auto pixelArrayByteCount = height * (width * bitsPerPixel + rowPaddingBitCount) / bitsPerByte;
-    return pixelArrayByteCount;
+    return width * bitsPerPixel / bitsPerByte + getPixelArrayPaddingByteCount(width);
 }
 
-void writeBitmapFile(const std::string& path, const Image& image)
+static uint64_t getPixelArrayByteCount(const int width, const int height)
 {
-    const auto pixelArrayByteCount = getPixelArrayByteCount(image.width(), image.height());
-    const auto padding = getPixelArrayPaddingByteCount(image.width());
+    return static_cast<uint64_t>(getRowByteCount(width)) * height;
+}
 
-    auto bytes = std::vector<uint8_t>(pixelArrayByteOffset + pixelArrayByteCount, 0);
+// Sizes that do not fit their 32-bit fields are recorded as zero, which uncompressed bitmaps allow.
+static void writeHeaders(std::vector<uint8_t>& bytes, const int width, const int height)
+{
+    const auto pixelArrayByteCount = getPixelArrayByteCount(width, height);
+    const auto fileByteCount = pixelArrayByteOffset + pixelArrayByteCount;
 
-    const auto write = [&bytes](const int offset, const int byteCount, const uint32_t value)
+    bytes.resize(pixelArrayByteOffset, 0);
+
+    const auto write = [&bytes](const int offset, const int byteCount, const uint64_t value)
     {
+        const auto field = value > std::numeric_limits<uint32_t>::max() ? 0 : value;
         for (auto index = 0; index < byteCount; ++index)
         {
-            bytes[offset + index] = (value >> (index * bitsPerByte)) & 0xFF;
+            bytes[offset + index] = (field >> (index * bitsPerByte)) & 0xFF;
         }
     };
 
     bytes[0] = firstMagicByte;
     bytes[1] = secondMagicByte;
 
-    write(0x02, 4, pixelArrayByteOffset + pixelArrayByteCount);
+    write(0x02, 4, fileByteCount);
     write(0x0A, 4, pixelArrayByteOffset);
     write(0x0E, 4, dibHeaderByteCount);
-    write(0x12, 4, image.width());
-    write(0x16, 4, image.height());
+    write(0x12, 4, width);
+    write(0x16, 4, height);
     write(0x1A, 2, colorPlanesCount);
     write(0x1C, 2, bitsPerPixel);
     write(0x22, 4, pixelArrayByteCount);
     write(0x26, 4, horizontalPixelsPerMeter);
     write(0x2A, 4, verticalPixelsPerMeter);
+}
 
-    auto index = pixelArrayByteOffset;
+void writeBitmapBinary(ByteSink& sink, const Image& image)
+{
+    auto buffer = SinkBuffer{sink};
+    auto& bytes = buffer.bytes();
+    writeHeaders(bytes, image.width(), image.height());
+
+    static const auto convertRow = getRgbaRowToBgrConverter();
+
+    // Rows are converted whole, bottom row first, into zeroed space so the padding is already in place, and handed to
+    // the sink once the buffer fills up.
+    const auto rowByteCount = getRowByteCount(image.width());
     for (auto h = 0; h < image.height(); ++h)
     {
-        for (auto w = 0; w < image.width(); ++w)
+        const auto offset = bytes.size();
+        bytes.resize(offset + rowByteCount, 0);
+        convertRow(image.bytes() + static_cast<size_t>(image.height() - h - 1) * image.width() * sizeof(Color),
+                   bytes.data() + offset, image.width());
+
+        buffer.flushIfFull();
+    }
+
+    buffer.flush();
+}
+
+void writeBitmapFile(const std::string& path, const Image& image)
+{
+    auto sink = FileSink{path};
+    writeBitmapBinary(sink, image);
+    sink.commit();
+}
+
+// Runs ahead of the stream in the member initializers, so invalid dimensions do not truncate an existing file.
+static const std::string& validateWriterDimensions(const std::string& path, const int width, const int height)
+{
+    if (width <= 0 || height <= 0 || static_cast<uint32_t>(width) > maximumDimension ||
+        static_cast<uint32_t>(height) > maximumDimension)
+    {
+        THROW(std::invalid_argument, "bitmap writer dimensions ", width, "x", height, " must be between 1 and ",
+              maximumDimension);
+    }
+    return path;
+}
+
+BitmapWriter::BitmapWriter(const std::string& path, const int width, const int height)
+    : path_{validateWriterDimensions(path, width, height)},
+      stream_{path, std::ios::binary | std::ios::trunc},
+      width_{width},
+      height_{height}
+{
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "could not open file ", path, " for writing");
+    }
+
+    // Writing the last byte up front gives the file its full size, so rows that are never written read as black.
+    auto headers = std::vector<uint8_t>{};
+    writeHeaders(headers, width_, height_);
+    stream_.write(reinterpret_cast<const char*>(headers.data()), headers.size());
+    stream_.seekp(static_cast<std::streamoff>(pixelArrayByteOffset + getPixelArrayByteCount(width_, height_) - 1));
+    stream_.put(0);
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "failed to write to file ", path_);
+    }
+
+    LOG_DEBUG("opened bitmap writer for ", width, "x", height, " image at ", path);
+}
+
+BitmapWriter::~BitmapWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& exception)
+    {
+        LOG_DEBUG("failed to close bitmap writer: ", exception.what());
+    }
+}
+
+void BitmapWriter::writeRows(const int y, const Image& band)
+{
+    if (!stream_.is_open())
+    {
+        THROW(std::logic_error, "cannot write rows to a closed bitmap writer");
+    }
+
+    if (band.width() != width_ || y < 0 || band.height() > height_ - y)
+    {
+        THROW(std::invalid_argument, "cannot write a ", band.width(), "x", band.height(), " band at row ", y,
+              " of a ", width_, "x", height_, " bitmap");
+    }
+
+    static const auto convertRow = getRgbaRowToBgrConverter();
+
+    // The rows of a band are next to each other in the file, bottom row first, so the whole band is converted in file
+    // order and written with a single seek. Padding always falls in the same places and stays zero.
+    const auto rowByteCount = getRowByteCount(width_);
+    buffer_.resize(static_cast<size_t>(rowByteCount) * band.height(), 0);
+    for (auto row = 0; row < band.height(); ++row)
+    {
+        convertRow(band.bytes() + static_cast<size_t>(band.height() - row - 1) * band.width() * sizeof(Color),
+                   buffer_.data() + static_cast<size_t>(row) * rowByteCount, width_);
+    }
+
+    const auto bottomRow = height_ - y - band.height();
+    stream_.seekp(static_cast<std::streamoff>(pixelArrayByteOffset + static_cast<uint64_t>(bottomRow) * rowByteCount));
+    stream_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "failed to write to file ", path_);
+    }
+}
+
+void BitmapWriter::close()
+{
+    if (stream_.is_open())
+    {
+        stream_.close();
+        buffer_ = std::vector<uint8_t>{};
+        if (!stream_)
         {
-            const auto color = image(w, image.height() - h - 1);
-            bytes[index] = color.blue();
-            bytes[index + 1] = color.green();
-            bytes[index + 2] = color.red();
-            index += 3;
+            THROW(std::runtime_error, "failed to close file ", path_);
         }
-        index += padding;
+    }
+}
+
+// The mapping is read only and private, and sequential access is hinted since rows are read in order. Empty files
+// are not mapped at all and are left to fail the header checks.
+static std::pair<const uint8_t*, size_t> mapFile(const std::string& path)
+{
+#ifdef _WIN32
+    const auto file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        THROW(std::runtime_error, "could not open file ", path, " for reading");
+    }
+
+    auto fileSize = LARGE_INTEGER{};
+    if (!::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        ::CloseHandle(file);
+        return {nullptr, 0};
+    }
+
+    // The view keeps the file mapped after both handles are closed.
+    const auto mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (mapping == nullptr)
+    {
+        THROW(std::runtime_error, "could not map file ", path);
+    }
+
+    const auto view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping);
+    if (view == nullptr)
+    {
+        THROW(std::runtime_error, "could not map file ", path);
+    }
+
+    return {static_cast<const uint8_t*>(view), static_cast<size_t>(fileSize.QuadPart)};
+#else
+    const auto descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        THROW(std::runtime_error, "could not open file ", path, " for reading: ", std::strerror(errno));
+    }
+
+    struct stat status;
+    if (::fstat(descriptor, &status) != 0 || status.st_size == 0)
+    {
+        ::close(descriptor);
+        return {nullptr, 0};
+    }
+
+    const auto size = static_cast<size_t>(status.st_size);
+    const auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+    if (data == MAP_FAILED)
+    {
+        THROW(std::runtime_error, "could not map file ", path, ": ", std::strerror(errno));
     }
 
-    writeBinaryFile(path, bytes);
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return {static_cast<const uint8_t*>(data), size};
+#endif
 }
 
-Image readBitmapFile(const std::string& path)
+static void unmapFile(const uint8_t* const data, const size_t size)
 {
-    const auto binary = readBinaryFile(path);
-    const auto binarySize = static_cast<int>(binary.size());
+    if (data == nullptr)
+    {
+        return;
+    }
 
-    const auto read = [&binary](const int offset, const int byteCount, uint32_t& value)
+#ifdef _WIN32
+    ::UnmapViewOfFile(data);
+#else
+    ::munmap(const_cast<uint8_t*>(data), size);
+#endif
+}
+
+BitmapView::BitmapView(const std::string& path)
+    : data_{nullptr},
+      size_{0},
+      pixels_{nullptr},
+      pixelsByteCount_{0},
+      width_{0},
+      height_{0},
+      bitsPerPixel_{0},
+      rowByteCount_{0},
+      compressed_{false},
+      topDown_{false},
+      hasAlpha_{false}
+{
+    std::tie(data_, size_) = mapFile(path);
+    try
+    {
+        readHeaders();
+    }
+    catch (...)
+    {
+        unmapFile(data_, size_);
+        throw;
+    }
+}
+
+BitmapView::BitmapView(BitmapView&& other) noexcept
+    : data_{std::exchange(other.data_, nullptr)},
+      size_{std::exchange(other.size_, 0)},
+      pixels_{std::exchange(other.pixels_, nullptr)},
+      pixelsByteCount_{std::exchange(other.pixelsByteCount_, 0)},
+      width_{std::exchange(other.width_, 0)},
+      height_{std::exchange(other.height_, 0)},
+      bitsPerPixel_{other.bitsPerPixel_},
+      rowByteCount_{other.rowByteCount_},
+      compressed_{other.compressed_},
+      topDown_{other.topDown_},
+      hasAlpha_{other.hasAlpha_},
+      palette_{std::move(other.palette_)}
+{
+}
+
+BitmapView& BitmapView::operator=(BitmapView&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmapFile(data_, size_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        pixels_ = std::exchange(other.pixels_, nullptr);
+        pixelsByteCount_ = std::exchange(other.pixelsByteCount_, 0);
+        width_ = std::exchange(other.width_, 0);
+        height_ = std::exchange(other.height_, 0);
+        bitsPerPixel_ = other.bitsPerPixel_;
+        rowByteCount_ = other.rowByteCount_;
+        compressed_ = other.compressed_;
+        topDown_ = other.topDown_;
+        hasAlpha_ = other.hasAlpha_;
+        palette_ = std::move(other.palette_);
+    }
+    return *this;
+}
+
+BitmapView::~BitmapView()
+{
+    unmapFile(data_, size_);
+}
+
+// Checks the headers in place. The masks of 32 bit fields must be the usual byte order, and only V4 and V5 headers
+// can give an alpha mask.
+void BitmapView::readHeaders()
+{
+    const auto binary = data_;
+    const auto binarySize = size_;
+
+    const auto read = [binary](const int offset, const int byteCount, uint32_t& value)
     {
         value = 0;
         for (auto index = 0; index < byteCount; ++index)
@@ -107,7 +664,7 @@ Image readBitmapFile(const std::string& path)
         }
     };
 
-    if (binarySize < dibHeaderByteCount)
+    if (binarySize < fileHeaderByteCount + dibHeaderByteCount)
     {
         THROW(BitmapReadException, "bitmap is missing bytes from the DIB header");
     }
@@ -122,38 +679,48 @@ Image readBitmapFile(const std::string& path)
     auto value = uint32_t{0};
 
     read(0x02, 4, value);
-    if (value != static_cast<uint32_t>(binarySize))
+    if (value != binarySize && value != 0)
     {
         THROW(BitmapReadException, "read bitmap file size ", value, " does not match actual size ", binarySize);
     }
 
     read(0x0A, 4, value);
-    if (value != pixelArrayByteOffset)
+    const auto pixelArrayOffset = static_cast<size_t>(value);
+    if (pixelArrayOffset > binarySize)
     {
-        THROW(BitmapReadException, "read pixel array byte offset ", value, " is not supported -- only ",
-              pixelArrayByteOffset, " is supported");
+        THROW(BitmapReadException, "read pixel array byte offset ", pixelArrayOffset, " is past the end of the file");
     }
 
     read(0x0E, 4, value);
-    if (value != dibHeaderByteCount)
+    if (value != dibHeaderByteCount && value != v4HeaderByteCount && value != v5HeaderByteCount)
     {
         THROW(BitmapReadException, "read bitmap DIB header size ", value, " is not supported -- only ",
-              dibHeaderByteCount, " is supported");
+              dibHeaderByteCount, ", ", v4HeaderByteCount, " and ", v5HeaderByteCount, " are supported");
+    }
+    const auto headerByteCount = static_cast<int>(value);
+    if (binarySize < static_cast<size_t>(fileHeaderByteCount + headerByteCount))
+    {
+        THROW(BitmapReadException, "bitmap is missing bytes from the DIB header");
     }
 
     read(0x12, 4, value);
     if (value > maximumDimension)
     {
-        THROW(BitmapReadException, "read bitmap width ", value, " is larger than the maximum of ", maximumDimension);
+        THROW(BitmapReadException, "read bitmap width ", static_cast<int32_t>(value), " is outside the range 0 to ",
+              maximumDimension);
     }
-    const auto width = static_cast<int>(value);
+    width_ = static_cast<int>(value);
 
+    // A negative height stores the rows top-down.
     read(0x16, 4, value);
-    if (value > maximumDimension)
+    const auto signedHeight = static_cast<int32_t>(value);
+    topDown_ = signedHeight < 0;
+    if (static_cast<uint32_t>(topDown_ ? -static_cast<int64_t>(signedHeight) : signedHeight) > maximumDimension)
     {
-        THROW(BitmapReadException, "read bitmap height ", value, " is larger than the maximum of ", maximumDimension);
+        THROW(BitmapReadException, "read bitmap height ", signedHeight, " is larger than the maximum of ",
+              maximumDimension);
     }
-    const auto height = static_cast<int>(value);
+    height_ = topDown_ ? -signedHeight : signedHeight;
 
     read(0x1A, 2, value);
     if (value != colorPlanesCount)
@@ -163,42 +730,278 @@ Image readBitmapFile(const std::string& path)
     }
 
     read(0x1C, 2, value);
-    if (value != bitsPerPixel)
+    bitsPerPixel_ = static_cast<int>(value);
+    if (bitsPerPixel_ != 1 && bitsPerPixel_ != 4 && bitsPerPixel_ != 8 && bitsPerPixel_ != 24 && bitsPerPixel_ != 32)
     {
-        THROW(BitmapReadException, "read bitmap bits per pixel ", value, " is not supported -- only ", bitsPerPixel,
-              " is supported");
+        THROW(BitmapReadException, "read bitmap bits per pixel ", value,
+              " is not supported -- only 1, 4, 8, 24 and 32 are supported");
     }
 
-    const auto pixelArrayByteCount = getPixelArrayByteCount(width, height);
-    read(0x22, 4, value);
-    if (value != static_cast<uint32_t>(pixelArrayByteCount))
+    read(0x1E, 4, value);
+    const auto compression = static_cast<int>(value);
+    const auto isRunLength = (compression == rle8Compression && bitsPerPixel_ == 8) ||
+                             (compression == rle4Compression && bitsPerPixel_ == 4);
+    if (compression != uncompressed && !isRunLength && !(compression == bitfieldsCompression && bitsPerPixel_ == 32))
     {
-        THROW(BitmapReadException, "read bitmap pixel array size (with padding) ", value,
-              " does not match expected size ", pixelArrayByteCount);
+        THROW(BitmapReadException, "read bitmap compression ", compression, " is not supported at ", bitsPerPixel_,
+              " bits per pixel");
     }
-    if (binarySize != pixelArrayByteOffset + pixelArrayByteCount)
+    if (isRunLength && topDown_)
     {
-        THROW(BitmapReadException, "bitmap file size ", binarySize, " does not match expected size ",
-              pixelArrayByteOffset + pixelArrayByteCount);
+        THROW(BitmapReadException, "compressed bitmaps cannot store their rows top-down");
     }
+    compressed_ = isRunLength;
 
-    const auto padding = getPixelArrayPaddingByteCount(width);
+    auto colorTableOffset = fileHeaderByteCount + headerByteCount;
+    if (compression == bitfieldsCompression)
+    {
+        // Info headers are followed by the three color masks, while V4 and V5 headers hold them along with alpha.
+        const auto masksOffset = fileHeaderByteCount + dibHeaderByteCount;
+        if (headerByteCount == dibHeaderByteCount)
+        {
+            colorTableOffset += 3 * 4;
+            if (binarySize < static_cast<size_t>(colorTableOffset))
+            {
+                THROW(BitmapReadException, "bitmap is missing bytes from the color masks");
+            }
+        }
 
-    auto index = pixelArrayByteOffset;
-    auto image = Image{width, height};
-    for (auto h = 0; h < height; ++h)
+        auto masks = std::array<uint32_t, 4>{};
+        for (auto index = 0; index < (headerByteCount == dibHeaderByteCount ? 3 : 4); ++index)
+        {
+            read(masksOffset + 4 * index, 4, masks[index]);
+        }
+
+        if (masks[0] != redMask || masks[1] != greenMask || masks[2] != blueMask ||
+            (masks[3] != 0 && masks[3] != alphaMask))
+        {
+            THROW(BitmapReadException, "read bitmap color masks ", masks[0], ", ", masks[1], ", ", masks[2], " and ",
+                  masks[3], " are not supported -- only blue, green, red and alpha bytes in order are supported");
+        }
+        hasAlpha_ = masks[3] == alphaMask;
+    }
+
+    palette_.clear();
+    if (bitsPerPixel_ <= 8)
     {
-        for (auto w = 0; w < width; ++w)
+        read(0x2E, 4, value);
+        const auto paletteSize = value == 0 ? uint32_t{1} << bitsPerPixel_ : value;
+        if (paletteSize > (uint32_t{1} << bitsPerPixel_))
         {
-            read(index, 3, value);
-            (value <<= 8) |= 0xFF;
-            image(w, height - h - 1) = Color{value};
-            index += 3;
+            THROW(BitmapReadException, "read bitmap palette size ", paletteSize, " is larger than the maximum of ",
+                  1 << bitsPerPixel_, " at ", bitsPerPixel_, " bits per pixel");
+        }
+        if (pixelArrayOffset < colorTableOffset + 4 * paletteSize)
+        {
+            THROW(BitmapReadException, "read pixel array byte offset ", pixelArrayOffset,
+                  " overlaps the color table");
+        }
+
+        for (auto entry = binary + colorTableOffset; entry != binary + colorTableOffset + 4 * paletteSize; entry += 4)
+        {
+            palette_.push_back(Color{entry[2], entry[1], entry[0]});
+        }
+    }
+    else if (pixelArrayOffset < static_cast<size_t>(colorTableOffset))
+    {
+        THROW(BitmapReadException, "read pixel array byte offset ", pixelArrayOffset, " overlaps the headers");
+    }
+
+    rowByteCount_ = (width_ * bitsPerPixel_ + rowRoundUpByteCount * bitsPerByte - 1) /
+                    (rowRoundUpByteCount * bitsPerByte) * rowRoundUpByteCount;
+
+    pixels_ = binary + pixelArrayOffset;
+    pixelsByteCount_ = binarySize - pixelArrayOffset;
+
+    if (compressed_)
+    {
+        read(0x22, 4, value);
+        if (value > pixelsByteCount_)
+        {
+            THROW(BitmapReadException, "read bitmap compressed size ", value, " is larger than the remaining ",
+                  pixelsByteCount_, " bytes");
+        }
+        pixelsByteCount_ = value == 0 ? pixelsByteCount_ : value;
+    }
+    else if (pixelsByteCount_ < static_cast<size_t>(rowByteCount_) * height_)
+    {
+        THROW(BitmapReadException, "bitmap pixel array has ", pixelsByteCount_, " bytes but ",
+              static_cast<size_t>(rowByteCount_) * height_, " are expected");
+    }
+}
+
+const uint8_t* BitmapView::row(const int y) const
+{
+    if (compressed_)
+    {
+        THROW(std::logic_error, "cannot view the rows of a compressed bitmap");
+    }
+
+    if (y < 0 || y >= height_)
+    {
+        THROW(std::out_of_range, "cannot view row ", y, " of a bitmap of height ", height_);
+    }
+    return pixels_ + static_cast<size_t>(topDown_ ? y : height_ - y - 1) * rowByteCount_;
+}
+
+// Runs either repeat one index, or two alternating ones at 4 bits, or list absolute indexes padded to an even number
+// of bytes. The escapes end a row, end the bitmap or skip ahead, and skipped pixels are left black. Pixels past the
+// right edge are dropped, and the end of bitmap marker may be missing once every row is done.
+static Image decodeRunLengths(const uint8_t* const pixels, const size_t byteCount, const int width, const int height,
+                              const int bits, const Color* const palette)
+{
+    auto colors = std::vector<Color>(static_cast<size_t>(width) * height);
+    auto x = 0;
+    auto y = 0;
+    auto position = size_t{0};
+
+    const auto rowColors = [&]() { return colors.data() + static_cast<size_t>(height - y - 1) * width; };
+
+    while (true)
+    {
+        if (position + 2 > byteCount)
+        {
+            if (y >= height)
+            {
+                break;
+            }
+            THROW(BitmapReadException, "compressed pixel data ends before the end of the bitmap");
+        }
+
+        const auto count = static_cast<int>(pixels[position]);
+        const auto code = pixels[position + 1];
+        position += 2;
+
+        if (count > 0)
+        {
+            if (y < height)
+            {
+                const auto end = std::min(x + count, width);
+                if (bits == 8)
+                {
+                    std::fill(rowColors() + x, rowColors() + end, palette[code]);
+                }
+                else
+                {
+                    const Color pair[] = {palette[code >> 4], palette[code & 0x0F]};
+                    for (auto w = x; w < end; ++w)
+                    {
+                        rowColors()[w] = pair[(w - x) & 1];
+                    }
+                }
+            }
+            x = std::min(x + count, width);
+        }
+        else if (code == endOfLine)
+        {
+            x = 0;
+            y = std::min(y + 1, height);
+        }
+        else if (code == endOfBitmap)
+        {
+            break;
+        }
+        else if (code == delta)
+        {
+            if (position + 2 > byteCount)
+            {
+                THROW(BitmapReadException, "compressed pixel data ends inside a delta");
+            }
+            x = std::min(x + pixels[position], width);
+            y = std::min(y + pixels[position + 1], height);
+            position += 2;
+        }
+        else
+        {
+            const auto runByteCount = static_cast<size_t>(bits == 8 ? code : (code + 1) / 2);
+            if (position + runByteCount + (runByteCount & 1) > byteCount)
+            {
+                THROW(BitmapReadException, "compressed pixel data ends inside an absolute run");
+            }
+
+            if (y < height)
+            {
+                const auto end = std::min(x + static_cast<int>(code), width);
+                const auto indexes = pixels + position;
+                for (auto w = x; w < end; ++w)
+                {
+                    const auto offset = w - x;
+                    rowColors()[w] = palette[bits == 8 ? indexes[offset]
+                                                       : (indexes[offset / 2] >> (offset & 1 ? 0 : 4)) & 0x0F];
+                }
+            }
+            x = std::min(x + static_cast<int>(code), width);
+            position += runByteCount + (runByteCount & 1);
         }
-        index += padding;
     }
 
-    return image;
+    return Image{width, height, std::move(colors)};
+}
+
+Image BitmapView::toImage() const
+{
+    // Indexes outside the palette show black, the same as the padding of a bitmap with a short palette.
+    auto lookup = std::vector<Color>(maximumPaletteSize, Color{Colors::black});
+    std::copy(palette_.cbegin(), palette_.cend(), lookup.begin());
+
+    if (compressed_)
+    {
+        return decodeRunLengths(pixels_, pixelsByteCount_, width_, height_, bitsPerPixel_, lookup.data());
+    }
+
+    // Rows are converted into one reused row and appended to reserved colors, which spares filling the whole image
+    // before it is overwritten.
+    auto row = std::vector<Color>(width_);
+    auto colors = std::vector<Color>{};
+    colors.reserve(static_cast<size_t>(width_) * height_);
+
+    const auto convertRows = [&](auto&& convertRow)
+    {
+        for (auto y = 0; y < height_; ++y)
+        {
+            convertRow(this->row(y), row.data());
+            colors.insert(colors.end(), row.cbegin(), row.cend());
+        }
+    };
+
+    const auto asBytes = [](Color* const pixels) { return static_cast<uint8_t*>(static_cast<void*>(pixels)); };
+
+    switch (bitsPerPixel_)
+    {
+    case 1:
+        convertRows([&](const uint8_t* bytes, Color* destination)
+                    { convertIndexedRowToRgba<1>(bytes, destination, width_, lookup.data()); });
+        break;
+    case 4:
+        convertRows([&](const uint8_t* bytes, Color* destination)
+                    { convertIndexedRowToRgba<4>(bytes, destination, width_, lookup.data()); });
+        break;
+    case 8:
+        convertRows([&](const uint8_t* bytes, Color* destination)
+                    { convertIndexedRowToRgba<8>(bytes, destination, width_, lookup.data()); });
+        break;
+    case 24:
+    {
+        static const auto convertRow = getBgrRowToRgbaConverter();
+        convertRows([&](const uint8_t* bytes, Color* destination) { convertRow(bytes, asBytes(destination), width_); });
+        break;
+    }
+    default:
+    {
+        static const auto convertRowWithAlpha = getBgraRowToRgbaConverter<true>();
+        static const auto convertOpaqueRow = getBgraRowToRgbaConverter<false>();
+        const auto convertRow = hasAlpha_ ? convertRowWithAlpha : convertOpaqueRow;
+        convertRows([&](const uint8_t* bytes, Color* destination) { convertRow(bytes, asBytes(destination), width_); });
+        break;
+    }
+    }
+
+    return Image{width_, height_, std::move(colors)};
+}
+
+Image readBitmapFile(const std::string& path)
+{
+    return BitmapView{path}.toImage();
 }
 
 }
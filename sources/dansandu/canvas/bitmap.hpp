@@ -1,9 +1,15 @@
 #pragma once
 
+#include "dansandu/canvas/color.hpp"
 #include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/sink.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <fstream>
 #include <string>
+#include <vector>
 
 namespace dansandu::canvas::bitmap
 {
@@ -24,8 +30,112 @@ private:
     std::string message_;
 };
 
+// Maps a bitmap file into memory and reads its rows in place, so the pixels are never copied into a buffer of their
+// own. The file stays mapped for as long as the view lives. Info, V4 and V5 headers are read, with 1, 4, 8, 24 or 32
+// bits per pixel, rows stored bottom-up or top-down, and 8 and 4 bit palettes compressed with run lengths.
+class PRALINE_EXPORT BitmapView
+{
+public:
+    explicit BitmapView(const std::string& path);
+
+    BitmapView(const BitmapView&) = delete;
+
+    BitmapView(BitmapView&& other) noexcept;
+
+    BitmapView& operator=(const BitmapView&) = delete;
+
+    BitmapView& operator=(BitmapView&& other) noexcept;
+
+    ~BitmapView();
+
+    int width() const noexcept
+    {
+        return width_;
+    }
+
+    int height() const noexcept
+    {
+        return height_;
+    }
+
+    int bitsPerPixel() const noexcept
+    {
+        return bitsPerPixel_;
+    }
+
+    bool compressed() const noexcept
+    {
+        return compressed_;
+    }
+
+    // The colors that pixels of 8 bits or fewer index, which is empty for the other bitmaps.
+    const std::vector<dansandu::canvas::color::Color>& palette() const noexcept
+    {
+        return palette_;
+    }
+
+    // Bytes between the starts of consecutive rows, including the padding that rounds rows up to four bytes.
+    int rowByteCount() const noexcept
+    {
+        return rowByteCount_;
+    }
+
+    // The bytes of row y, counted from the top as in images. Pixels are blue, green and red bytes, followed by alpha
+    // at 32 bits, or palette indexes packed from the high bits at 8 bits or fewer. Compressed bitmaps have no rows to
+    // view.
+    const uint8_t* row(const int y) const;
+
+    dansandu::canvas::image::Image toImage() const;
+
+private:
+    void readHeaders();
+
+    const uint8_t* data_;
+    size_t size_;
+    const uint8_t* pixels_;
+    size_t pixelsByteCount_;
+    int width_;
+    int height_;
+    int bitsPerPixel_;
+    int rowByteCount_;
+    bool compressed_;
+    bool topDown_;
+    bool hasAlpha_;
+    std::vector<dansandu::canvas::color::Color> palette_;
+};
+
 PRALINE_EXPORT dansandu::canvas::image::Image readBitmapFile(const std::string& path);
 
+PRALINE_EXPORT void writeBitmapBinary(dansandu::canvas::sink::ByteSink& sink,
+                                      const dansandu::canvas::image::Image& image);
+
 PRALINE_EXPORT void writeBitmapFile(const std::string& path, const dansandu::canvas::image::Image& image);
 
+// Writes a bitmap file of known dimensions a band of rows at a time, so memory usage is bound by a single band however
+// large the image is. Bands can come in any order since each is written at the offset of its rows, and rows that are
+// never written are left black. Files too large for the 32-bit size fields record zero sizes instead.
+class PRALINE_EXPORT BitmapWriter
+{
+public:
+    BitmapWriter(const std::string& path, const int width, const int height);
+
+    BitmapWriter(const BitmapWriter&) = delete;
+
+    BitmapWriter& operator=(const BitmapWriter&) = delete;
+
+    ~BitmapWriter();
+
+    // Writes the rows of the band starting at row y, counted from the top as in images.
+    void writeRows(const int y, const dansandu::canvas::image::Image& band);
+
+    void close();
+
+private:
+    std::string path_;
+    std::ofstream stream_;
+    int width_;
+    int height_;
+    std::vector<uint8_t> buffer_;
+};
+
 }
@@ -1,14 +1,28 @@
 #include "dansandu/canvas/bitmap.hpp"
 #include "catchorg/catch/catch.hpp"
+#include "dansandu/ballotin/file_system.hpp"
 #include "dansandu/ballotin/string.hpp"
 #include "dansandu/canvas/color.hpp"
 #include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/sink.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using dansandu::ballotin::file_system::readBinaryFile;
+using dansandu::ballotin::file_system::writeBinaryFile;
 using dansandu::ballotin::string::format;
+using dansandu::canvas::bitmap::BitmapReadException;
+using dansandu::canvas::bitmap::BitmapView;
+using dansandu::canvas::bitmap::BitmapWriter;
 using dansandu::canvas::bitmap::readBitmapFile;
+using dansandu::canvas::bitmap::writeBitmapBinary;
 using dansandu::canvas::bitmap::writeBitmapFile;
+using dansandu::canvas::color::Color;
 using dansandu::canvas::color::Colors;
 using dansandu::canvas::image::Image;
+using dansandu::canvas::sink::CallbackSink;
 
 static void REQUIRE_IMAGE(const Image& actualImage, const std::string& fileName)
 {
@@ -27,6 +41,61 @@ static void REQUIRE_IMAGE(const Image& actualImage, const std::string& fileName)
     }
 }
 
+static Image makeNoisyImage(const int width, const int height)
+{
+    auto image = Image{width, height};
+    auto seed = 11U;
+    for (auto& color : image)
+    {
+        seed = seed * 1103515245U + 12345U;
+        color = Color{static_cast<Color::value_type>(seed >> 24), static_cast<Color::value_type>(seed >> 16),
+                      static_cast<Color::value_type>(seed >> 8)};
+    }
+    return image;
+}
+
+static void setField(std::vector<uint8_t>& binary, const int offset, const int byteCount, const uint32_t value)
+{
+    for (auto index = 0; index < byteCount; ++index)
+    {
+        binary[offset + index] = static_cast<uint8_t>(value >> (8 * index));
+    }
+}
+
+// Builds a bitmap file with the palette or color masks between the headers and the pixel array.
+static std::vector<uint8_t> makeBitmapBinary(const int headerByteCount, const int width, const int height,
+                                             const int bitsPerPixel, const int compression,
+                                             const std::vector<uint8_t>& colorTable, const std::vector<uint8_t>& pixels)
+{
+    const auto fileHeaderByteCount = 14;
+
+    auto binary = std::vector<uint8_t>(fileHeaderByteCount + headerByteCount);
+    binary.insert(binary.end(), colorTable.cbegin(), colorTable.cend());
+    const auto pixelArrayOffset = binary.size();
+    binary.insert(binary.end(), pixels.cbegin(), pixels.cend());
+
+    binary[0] = 'B';
+    binary[1] = 'M';
+    setField(binary, 0x02, 4, static_cast<uint32_t>(binary.size()));
+    setField(binary, 0x0A, 4, static_cast<uint32_t>(pixelArrayOffset));
+    setField(binary, 0x0E, 4, headerByteCount);
+    setField(binary, 0x12, 4, width);
+    setField(binary, 0x16, 4, static_cast<uint32_t>(height));
+    setField(binary, 0x1A, 2, 1);
+    setField(binary, 0x1C, 2, bitsPerPixel);
+    setField(binary, 0x1E, 4, compression);
+    setField(binary, 0x22, 4, static_cast<uint32_t>(pixels.size()));
+    setField(binary, 0x2E, 4, bitsPerPixel <= 8 ? static_cast<uint32_t>(colorTable.size() / 4) : 0);
+    return binary;
+}
+
+static Image readBitmapBinary(const std::vector<uint8_t>& binary)
+{
+    const auto path = std::string{"target/actual_format.bmp"};
+    writeBinaryFile(path, binary);
+    return readBitmapFile(path);
+}
+
 TEST_CASE("bitmap")
 {
     SECTION("rgb")
@@ -68,4 +137,342 @@ TEST_CASE("bitmap")
 
         REQUIRE(expected == actual);
     }
+
+    SECTION("sink")
+    {
+        const auto path = std::string{"resources/dansandu/canvas/expected_flower.bmp"};
+        const auto image = readBitmapFile(path);
+
+        auto chunksCount = 0;
+        auto actual = std::vector<uint8_t>{};
+        auto sink = CallbackSink{[&](const uint8_t* bytes, const size_t count)
+                                 {
+                                     ++chunksCount;
+                                     actual.insert(actual.end(), bytes, bytes + count);
+                                 }};
+        writeBitmapBinary(sink, image);
+
+        // The resource was saved without a print resolution, so only the pixel arrays are compared byte for byte.
+        const auto expected = readBinaryFile(path);
+        const auto pixelArrayByteOffset = 54;
+
+        REQUIRE(actual.size() == expected.size());
+        REQUIRE(std::equal(actual.cbegin() + pixelArrayByteOffset, actual.cend(),
+                           expected.cbegin() + pixelArrayByteOffset));
+        REQUIRE(chunksCount > 1);
+    }
+
+    SECTION("row widths")
+    {
+        for (const auto width : {1, 2, 3, 4, 5, 6, 7, 9, 11, 13, 16, 17, 23, 31, 33, 64})
+        {
+            const auto expected = makeNoisyImage(width, 3);
+
+            writeBitmapFile("target/actual_row_widths.bmp", expected);
+
+            REQUIRE(readBitmapFile("target/actual_row_widths.bmp") == expected);
+        }
+    }
+
+    SECTION("view")
+    {
+        const auto path = std::string{"target/actual_view.bmp"};
+        const auto image = makeNoisyImage(5, 3);
+        writeBitmapFile(path, image);
+
+        auto view = BitmapView{path};
+
+        REQUIRE(view.width() == 5);
+        REQUIRE(view.height() == 3);
+        REQUIRE(view.rowByteCount() == 16);
+
+        for (auto y = 0; y < image.height(); ++y)
+        {
+            for (auto x = 0; x < image.width(); ++x)
+            {
+                const auto pixel = view.row(y) + 3 * x;
+                REQUIRE(Color{pixel[2], pixel[1], pixel[0]} == image(x, y));
+            }
+        }
+
+        REQUIRE(view.toImage() == image);
+
+        REQUIRE_THROWS_AS(view.row(3), std::out_of_range);
+
+        const auto moved = std::move(view);
+
+        REQUIRE(moved.toImage() == image);
+    }
+
+    SECTION("invalid file")
+    {
+        writeBinaryFile("target/actual_truncated.bmp", std::vector<uint8_t>{0x42, 0x4D, 0, 0});
+
+        REQUIRE_THROWS_AS(BitmapView{"target/actual_truncated.bmp"}, BitmapReadException);
+
+        REQUIRE_THROWS_AS(readBitmapFile("target/missing.bmp"), std::runtime_error);
+    }
+}
+
+TEST_CASE("bitmap writer")
+{
+    const auto path = std::string{"target/actual_writer.bmp"};
+    const auto image = makeNoisyImage(7, 10);
+
+    const auto getBand = [&image](const int y, const int height)
+    {
+        auto band = Image{image.width(), height};
+        for (auto row = 0; row < height; ++row)
+        {
+            for (auto x = 0; x < image.width(); ++x)
+            {
+                band(x, row) = image(x, y + row);
+            }
+        }
+        return band;
+    };
+
+    SECTION("bands in any order")
+    {
+        {
+            auto writer = BitmapWriter{path, 7, 10};
+            writer.writeRows(6, getBand(6, 4));
+            writer.writeRows(0, getBand(0, 3));
+            writer.writeRows(3, getBand(3, 3));
+        }
+
+        writeBitmapFile("target/actual_writer_expected.bmp", image);
+
+        REQUIRE(readBinaryFile(path) == readBinaryFile("target/actual_writer_expected.bmp"));
+    }
+
+    SECTION("missing rows")
+    {
+        auto writer = BitmapWriter{path, 7, 10};
+        writer.writeRows(2, getBand(2, 3));
+        writer.close();
+
+        auto expected = Image{7, 10};
+        for (auto y = 2; y < 5; ++y)
+        {
+            for (auto x = 0; x < 7; ++x)
+            {
+                expected(x, y) = image(x, y);
+            }
+        }
+
+        REQUIRE(readBitmapFile(path) == expected);
+    }
+
+    SECTION("invalid bands")
+    {
+        auto writer = BitmapWriter{path, 7, 10};
+
+        REQUIRE_THROWS_AS(writer.writeRows(0, Image{6, 2}), std::invalid_argument);
+        REQUIRE_THROWS_AS(writer.writeRows(9, getBand(0, 2)), std::invalid_argument);
+        REQUIRE_THROWS_AS(writer.writeRows(-1, getBand(0, 2)), std::invalid_argument);
+
+        writer.close();
+
+        REQUIRE_THROWS_AS(writer.writeRows(0, getBand(0, 2)), std::logic_error);
+    }
+
+    SECTION("invalid dimensions")
+    {
+        writeBitmapFile(path, image);
+        const auto previous = readBinaryFile(path);
+
+        REQUIRE_THROWS_AS((BitmapWriter{path, 0, 10}), std::invalid_argument);
+        REQUIRE_THROWS_AS((BitmapWriter{path, 7, -1}), std::invalid_argument);
+
+        REQUIRE(readBinaryFile(path) == previous);
+    }
+}
+
+TEST_CASE("bitmap formats")
+{
+    const auto rgbPixels =
+        std::vector<uint8_t>{0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0, 0, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0, 0};
+    const auto palette =
+        std::vector<uint8_t>{0x00, 0x00, 0xFF, 0, 0x00, 0xFF, 0x00, 0, 0xFF, 0x00, 0x00, 0, 0xFF, 0xFF, 0xFF, 0};
+
+    SECTION("32 bits")
+    {
+        const auto pixels = std::vector<uint8_t>{0x00, 0x00, 0xFF, 0x00, 0x00, 0xFF, 0x00, 0x10, 0xFF, 0x00, 0x00, 0x20,
+                                                 0xFF, 0xFF, 0xFF, 0x30};
+
+        REQUIRE(readBitmapBinary(makeBitmapBinary(40, 2, 2, 32, 0, {}, pixels)) ==
+                Image{2, 2, {Colors::blue, Colors::white, Colors::red, Color{0x00, 0xFF, 0x00}}});
+
+        auto binary = makeBitmapBinary(108, 2, 2, 32, 3, {}, pixels);
+        setField(binary, 0x36, 4, 0x00FF0000U);
+        setField(binary, 0x3A, 4, 0x0000FF00U);
+        setField(binary, 0x3E, 4, 0x000000FFU);
+        setField(binary, 0x42, 4, 0xFF000000U);
+
+        REQUIRE(readBitmapBinary(binary) == Image{2, 2,
+                                                  {Color{0x00, 0x00, 0xFF, 0x20}, Color{0xFF, 0xFF, 0xFF, 0x30},
+                                                   Color{0xFF, 0x00, 0x00, 0x00}, Color{0x00, 0xFF, 0x00, 0x10}}});
+
+        setField(binary, 0x36, 4, 0x000000FFU);
+
+        REQUIRE_THROWS_AS(readBitmapBinary(binary), BitmapReadException);
+    }
+
+    SECTION("top-down rows")
+    {
+        const auto bottomUp = readBitmapBinary(makeBitmapBinary(124, 2, 2, 24, 0, {}, rgbPixels));
+        const auto topDown = readBitmapBinary(makeBitmapBinary(124, 2, -2, 24, 0, {}, rgbPixels));
+
+        REQUIRE(bottomUp == Image{2, 2, {Colors::blue, Colors::white, Colors::red, Color{0x00, 0xFF, 0x00}}});
+        REQUIRE(topDown == Image{2, 2, {Colors::red, Color{0x00, 0xFF, 0x00}, Colors::blue, Colors::white}});
+    }
+
+    SECTION("palettes")
+    {
+        const auto red = Color{Colors::red};
+        const auto green = Color{0x00, 0xFF, 0x00};
+        const auto blue = Color{Colors::blue};
+        const auto white = Color{Colors::white};
+
+        REQUIRE(readBitmapBinary(makeBitmapBinary(40, 5, 2, 1, 0, {palette.cbegin(), palette.cbegin() + 8},
+                                                  {0xB0, 0, 0, 0, 0x48, 0, 0, 0})) ==
+                Image{5, 2, {red, green, red, red, green, green, red, green, green, red}});
+
+        REQUIRE(readBitmapBinary(
+                    makeBitmapBinary(40, 5, 2, 4, 0, palette, {0x01, 0x23, 0x00, 0, 0x32, 0x10, 0x30, 0})) ==
+                Image{5, 2, {white, blue, green, red, white, red, green, blue, white, red}});
+
+        const auto view = BitmapView{"target/actual_format.bmp"};
+
+        REQUIRE(view.bitsPerPixel() == 4);
+        REQUIRE(view.palette() == std::vector<Color>{red, green, blue, white});
+
+        REQUIRE(readBitmapBinary(makeBitmapBinary(40, 3, 1, 8, 0, palette, {3, 1, 2, 0})) ==
+                Image{3, 1, {white, green, blue}});
+    }
+
+    SECTION("run lengths")
+    {
+        const auto black = Color{Colors::black};
+        const auto red = Color{Colors::red};
+        const auto green = Color{0x00, 0xFF, 0x00};
+        const auto blue = Color{Colors::blue};
+        const auto white = Color{Colors::white};
+
+        const auto rle8 = makeBitmapBinary(40, 4, 3, 8, 1, palette,
+                                           {3, 1, 0, 0, 0, 3, 2, 3, 0, 0, 1, 1, 0, 0, 0, 2, 2, 0, 2, 3, 0, 1});
+
+        REQUIRE(readBitmapBinary(rle8) ==
+                Image{4, 3, {black, black, white, white, blue, white, red, green, green, green, green, black}});
+
+        const auto view = BitmapView{"target/actual_format.bmp"};
+
+        REQUIRE(view.compressed());
+        REQUIRE_THROWS_AS(view.row(0), std::logic_error);
+
+        const auto rle4 = makeBitmapBinary(40, 5, 2, 4, 2, palette, {5, 0x12, 0, 0, 0, 3, 0x30, 0x20, 2, 0x11, 0, 1});
+
+        REQUIRE(readBitmapBinary(rle4) ==
+                Image{5, 2, {white, red, blue, green, green, green, blue, green, blue, green}});
+
+        REQUIRE_THROWS_AS(readBitmapBinary(makeBitmapBinary(40, 4, 3, 8, 1, palette, {3, 1, 0})),
+                          BitmapReadException);
+
+        REQUIRE_THROWS_AS(readBitmapBinary(makeBitmapBinary(40, 4, -3, 8, 1, palette, {0, 1})),
+                          BitmapReadException);
+    }
+
+    SECTION("unsupported compression")
+    {
+        REQUIRE_THROWS_AS(readBitmapBinary(makeBitmapBinary(40, 2, 2, 24, 4, {}, rgbPixels)), BitmapReadException);
+    }
+}
+
+TEST_CASE("bitmap benchmark", "[.benchmark]")
+{
+    SECTION("4k write throughput")
+    {
+        const auto image = makeNoisyImage(3840, 2160);
+        const auto repetitions = 20;
+
+        auto writtenBytes = 0ULL;
+        auto sink = CallbackSink{[&](const uint8_t*, const size_t count) { writtenBytes += count; }};
+        const auto start = std::chrono::steady_clock::now();
+        for (auto repetition = 0; repetition < repetitions; ++repetition)
+        {
+            writeBitmapBinary(sink, image);
+        }
+        const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+        REQUIRE(writtenBytes > 0ULL);
+
+        WARN("wrote " << image.width() << "x" << image.height() << " bitmaps at " << writtenBytes / seconds / 1.0e9
+                      << " GB/s");
+    }
+
+    SECTION("4k read throughput")
+    {
+        const auto path = std::string{"target/actual_4k.bmp"};
+        const auto image = makeNoisyImage(3840, 2160);
+        const auto repetitions = 20;
+
+        writeBitmapFile(path, image);
+
+        auto readBytes = 0ULL;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto repetition = 0; repetition < repetitions; ++repetition)
+        {
+            readBytes += readBitmapFile(path).size() * 3ULL;
+        }
+        const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+        REQUIRE(readBytes > 0ULL);
+
+        WARN("read " << image.width() << "x" << image.height() << " bitmaps at " << readBytes / seconds / 1.0e9
+                     << " GB/s");
+    }
+
+    SECTION("4k format read throughput")
+    {
+        const auto width = 3840;
+        const auto height = 2160;
+        const auto repetitions = 20;
+
+        auto palette = std::vector<uint8_t>{};
+        for (auto index = 0; index < 256; ++index)
+        {
+            palette.insert(palette.end(), {static_cast<uint8_t>(index), static_cast<uint8_t>(255 - index), 0x80, 0});
+        }
+
+        auto seed = 5U;
+        auto pixels = std::vector<uint8_t>(4 * width * height);
+        for (auto& byte : pixels)
+        {
+            seed = seed * 1103515245U + 12345U;
+            byte = static_cast<uint8_t>(seed >> 24);
+        }
+
+        const auto formats = {std::make_pair(32, makeBitmapBinary(40, width, height, 32, 0, {}, pixels)),
+                              std::make_pair(8, makeBitmapBinary(40, width, height, 8, 0, palette,
+                                                                 {pixels.cbegin(), pixels.cbegin() + width * height}))};
+        for (const auto& [bitsPerPixel, binary] : formats)
+        {
+            const auto path = std::string{"target/actual_4k_format.bmp"};
+            writeBinaryFile(path, binary);
+
+            auto readPixels = 0ULL;
+            const auto start = std::chrono::steady_clock::now();
+            for (auto repetition = 0; repetition < repetitions; ++repetition)
+            {
+                readPixels += readBitmapFile(path).size();
+            }
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            REQUIRE(readPixels > 0ULL);
+
+            WARN("read " << bitsPerPixel << " bit " << width << "x" << height << " bitmaps at "
+                         << readPixels / seconds / 1.0e6 << " Mpixels/s");
+        }
+    }
 }
@@ -1,19 +1,37 @@
 #include "dansandu/canvas/gif.hpp"
-#include "dansandu/ballotin/binary.hpp"
 #include "dansandu/ballotin/exception.hpp"
 #include "dansandu/ballotin/file_system.hpp"
 #include "dansandu/ballotin/logging.hpp"
 #include "dansandu/canvas/color.hpp"
+#include "dansandu/canvas/quantization.hpp"
+#include "dansandu/canvas/sink.hpp"
 #include "dansandu/range/range.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
-using dansandu::ballotin::binary::pushBits;
-using dansandu::ballotin::file_system::writeBinaryFile;
+using dansandu::ballotin::file_system::readBinaryFile;
 using dansandu::canvas::color::Color;
 using dansandu::canvas::color::Colors;
 using dansandu::canvas::image::Image;
+using dansandu::canvas::indexed_image::IndexedImage;
+using dansandu::canvas::sink::ByteSink;
+using dansandu::canvas::sink::FileSink;
+using dansandu::canvas::sink::MemorySink;
+using dansandu::canvas::sink::SinkBuffer;
+using dansandu::canvas::quantization::ColorHistogram;
+using dansandu::canvas::quantization::getMedianCutPalette;
+using dansandu::canvas::quantization::getOctreePalette;
+using dansandu::canvas::quantization::InversePalette;
 
 using namespace dansandu::range::range;
 
@@ -21,90 +39,483 @@ namespace dansandu::canvas::gif
 {
 
 static constexpr auto extensionIntroducer = 0x21;
+static constexpr auto imageDescriptorLabel = 0x2C;
+static constexpr auto graphicControlLabel = 0xF9;
 static constexpr auto minimumColorsPerTable = 4;
 static constexpr auto maximumColorsPerTable = 256;
 static constexpr auto maximumDataSubBlockSize = 255;
 static constexpr auto blockTerminator = 0x00;
 static constexpr auto trailer = 0x3B;
+static constexpr auto noTransparentColor = -1;
+static constexpr auto maximumDelayCentiseconds = 0xFFFF;
+static constexpr auto maximumLoopCount = 0xFFFF;
 
-std::pair<std::vector<uint8_t>, int> lzw(const std::vector<int>& input, const int alphabetSize)
+class LzwDictionary
 {
-    constexpr auto maximumCodeSize = 12;
+public:
+    static constexpr auto maximumCodeSize = 12;
+    static constexpr auto maximumCodesCount = 1 << maximumCodeSize;
 
+    LzwDictionary() : keys_(tableSize, emptyKey), codes_(tableSize)
+    {
+    }
+
+    int find(const int prefix, const int symbol) const
+    {
+        const auto key = (prefix << maximumCodeSize) | symbol;
+        for (auto slot = hash(key);; slot = (slot + 1) & (tableSize - 1))
+        {
+            if (keys_[slot] == key)
+            {
+                return codes_[slot];
+            }
+
+            if (keys_[slot] == emptyKey)
+            {
+                return notFound;
+            }
+        }
+    }
+
+    void insert(const int prefix, const int symbol, const int code)
+    {
+        const auto key = (prefix << maximumCodeSize) | symbol;
+        auto slot = hash(key);
+        while (keys_[slot] != emptyKey)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        keys_[slot] = key;
+        codes_[slot] = static_cast<uint16_t>(code);
+    }
+
+    void clear()
+    {
+        std::fill(keys_.begin(), keys_.end(), emptyKey);
+    }
+
+    static constexpr auto notFound = -1;
+
+private:
+    // Twice the maximum number of codes keeps the load factor under one half, so linear probing stays short.
+    static constexpr auto tableSize = 2 * maximumCodesCount;
+    static constexpr auto emptyKey = -1;
+
+    static int hash(const int key)
+    {
+        return static_cast<int>((static_cast<uint32_t>(key) * 2654435761U) >> 19) & (tableSize - 1);
+    }
+
+    std::vector<int32_t> keys_;
+    std::vector<uint16_t> codes_;
+};
+
+// Lists for every palette index the other indexes whose colors are within the lossiness distance of its color, nearest
+// first. When a sequence cannot be extended with the exact next index, the encoder tries these instead, so every pixel
+// is off by at most the lossiness. The transparent index is never substituted either way.
+class LzwSubstitutes
+{
+public:
+    static constexpr auto maximumSubstitutesCount = 32;
+
+    LzwSubstitutes(const std::vector<Color>& palette, const int lossiness, const int transparentIndex)
+        : substitutes_(palette.size() * maximumSubstitutesCount),
+          counts_(palette.size()),
+          wordsPerCode_{static_cast<int>(palette.size() + 63) / 64},
+          children_(LzwDictionary::maximumCodesCount * wordsPerCode_)
+    {
+        const auto colorsCount = static_cast<int>(palette.size());
+        auto candidates = std::vector<std::pair<int, int>>{};
+        for (auto index = 0; index < colorsCount; ++index)
+        {
+            candidates.clear();
+            for (auto other = 0; other < colorsCount && index != transparentIndex; ++other)
+            {
+                const auto red = palette[index].red() - palette[other].red();
+                const auto green = palette[index].green() - palette[other].green();
+                const auto blue = palette[index].blue() - palette[other].blue();
+                const auto distance = red * red + green * green + blue * blue;
+                if (other != index && other != transparentIndex && distance <= lossiness * lossiness)
+                {
+                    candidates.push_back({distance, other});
+                }
+            }
+
+            const auto count = std::min(static_cast<int>(candidates.size()), maximumSubstitutesCount);
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+            for (auto candidate = 0; candidate < count; ++candidate)
+            {
+                substitutes_[index * maximumSubstitutesCount + candidate] = candidates[candidate].second;
+            }
+            counts_[index] = count;
+        }
+    }
+
+    // Mirrors the dictionary as one bit per symbol for every prefix, so most substitutes are ruled out without a
+    // dictionary lookup.
+    void insert(const int prefix, const int symbol)
+    {
+        children_[prefix * wordsPerCode_ + symbol / 64] |= uint64_t{1} << (symbol % 64);
+    }
+
+    void clear()
+    {
+        std::fill(children_.begin(), children_.end(), 0);
+    }
+
+    int find(const LzwDictionary& dictionary, const int prefix, const int symbol) const
+    {
+        const auto children = children_.data() + prefix * wordsPerCode_;
+        const auto substitutes = substitutes_.data() + symbol * maximumSubstitutesCount;
+        for (auto substitute = substitutes; substitute < substitutes + counts_[symbol]; ++substitute)
+        {
+            if (children[*substitute / 64] & (uint64_t{1} << (*substitute % 64)))
+            {
+                return dictionary.find(prefix, *substitute);
+            }
+        }
+        return LzwDictionary::notFound;
+    }
+
+private:
+    std::vector<int> substitutes_;
+    std::vector<int> counts_;
+    int wordsPerCode_;
+    std::vector<uint64_t> children_;
+};
+
+// Packs codes least significant bit first into a 64-bit register and spills it 32 bits at a time. When framing is
+// enabled the bytes are split into data sub-blocks as they are written, so the image data needs no second copy.
+class LzwBitWriter
+{
+public:
+    LzwBitWriter(std::vector<uint8_t>& output, const bool isFramed, const int expectedBytesCount,
+                 SinkBuffer* const sinkBuffer = nullptr)
+        : output_{output},
+          register_{0},
+          registerBitsCount_{0},
+          bitsCount_{0},
+          isFramed_{isFramed},
+          blockStart_{0},
+          sinkBuffer_{sinkBuffer}
+    {
+        const auto framingBytesCount = isFramed ? expectedBytesCount / maximumDataSubBlockSize + 1 : 0;
+        if (!sinkBuffer_)
+        {
+            output_.reserve(output_.size() + expectedBytesCount + framingBytesCount);
+        }
+
+        if (isFramed_)
+        {
+            startBlock();
+        }
+    }
+
+    void write(const int code, const int codeSize)
+    {
+        register_ |= static_cast<uint64_t>(code) << registerBitsCount_;
+        registerBitsCount_ += codeSize;
+        bitsCount_ += codeSize;
+
+        if (registerBitsCount_ >= 32)
+        {
+            writeBytes(4);
+        }
+    }
+
+    void finish()
+    {
+        writeBytes((registerBitsCount_ + 7) / 8);
+        registerBitsCount_ = 0;
+
+        if (isFramed_)
+        {
+            const auto blockSize = static_cast<int>(output_.size() - blockStart_) - 1;
+            if (blockSize > 0)
+            {
+                output_[blockStart_] = static_cast<uint8_t>(blockSize);
+            }
+            else
+            {
+                output_.pop_back();
+            }
+        }
+    }
+
+    long long bitsCount() const
+    {
+        return bitsCount_;
+    }
+
+private:
+    void writeBytes(const int count)
+    {
+        for (auto byte = 0; byte < count; ++byte)
+        {
+            if (isFramed_ && static_cast<int>(output_.size() - blockStart_) > maximumDataSubBlockSize)
+            {
+                output_[blockStart_] = static_cast<uint8_t>(maximumDataSubBlockSize);
+
+                // Only complete sub-blocks are handed over, the size of the open one is not known yet.
+                if (sinkBuffer_)
+                {
+                    sinkBuffer_->flushIfFull();
+                }
+
+                startBlock();
+            }
+            output_.push_back(static_cast<uint8_t>(register_ & 0xFF));
+            register_ >>= 8;
+        }
+        registerBitsCount_ -= 8 * count;
+    }
+
+    void startBlock()
+    {
+        blockStart_ = output_.size();
+        output_.push_back(0);
+    }
+
+    std::vector<uint8_t>& output_;
+    uint64_t register_;
+    int registerBitsCount_;
+    long long bitsCount_;
+    bool isFramed_;
+    size_t blockStart_;
+    SinkBuffer* sinkBuffer_;
+};
+
+static int getMinimumCodeSize(const int alphabetSize)
+{
     auto minimumCodeSize = 0;
     while ((1 << minimumCodeSize) < alphabetSize)
     {
         ++minimumCodeSize;
     }
 
-    const auto clearCode = (1 << minimumCodeSize);
-    const auto endCode = clearCode + 1;
-
-    if (minimumCodeSize > maximumCodeSize)
+    if (minimumCodeSize > LzwDictionary::maximumCodeSize)
     {
         THROW(std::invalid_argument, "alphabet size is too large and requires ", minimumCodeSize,
-              " bits thus exceeding the maximum of ", maximumCodeSize, " bits");
+              " bits thus exceeding the maximum of ", LzwDictionary::maximumCodeSize, " bits");
     }
 
-    auto dictionary = std::vector<std::vector<int>>{};
+    return minimumCodeSize;
+}
 
-    auto sequence = std::vector<int>{};
-    auto index = 0;
+// Codes packed at the initial code size, which most inputs compress below.
+static int getExpectedLzwBytesCount(const int symbolsCount, const int minimumCodeSize)
+{
+    return static_cast<int>((static_cast<long long>(symbolsCount) * (minimumCodeSize + 1) + 7) / 8) + 8;
+}
 
-    auto output = std::vector<uint8_t>{};
-    auto bitsCount = 0;
-    auto code = 0;
-    auto codeSize = minimumCodeSize + 1;
+// Four passes over the rows of an interlaced image: every 8th row from row 0, every 8th from row 4, every 4th from
+// row 2 and every 2nd from row 1.
+static constexpr int interlacePassStarts[] = {0, 4, 2, 1};
+static constexpr int interlacePassSteps[] = {8, 8, 4, 2};
+static constexpr auto interlacePassesCount = 4;
 
-    pushBits(output, bitsCount, clearCode, codeSize);
+// Reads an index buffer in interlaced row order, so the encoder never needs a reordered copy of it.
+class InterlacedIterator
+{
+public:
+    InterlacedIterator(const uint8_t* const indexes, const int width, const int height)
+        : indexes_{indexes}, width_{width}, height_{height}, pass_{0}, row_{0}, column_{0}
+    {
+    }
 
-    while (index < static_cast<int>(input.size()))
+    uint8_t operator*() const
     {
-        sequence.push_back(input[index]);
+        return indexes_[row_ * width_ + column_];
+    }
 
-        if (sequence.size() == 1)
+    InterlacedIterator& operator++()
+    {
+        if (++column_ == width_)
         {
-            code = sequence.back();
-            ++index;
+            column_ = 0;
+            row_ += interlacePassSteps[pass_];
+            while (row_ >= height_ && ++pass_ < interlacePassesCount)
+            {
+                row_ = interlacePassStarts[pass_];
+            }
         }
-        else if (auto entry = std::find(dictionary.cbegin(), dictionary.cend(), sequence); entry != dictionary.end())
+        return *this;
+    }
+
+private:
+    const uint8_t* indexes_;
+    int width_;
+    int height_;
+    int pass_;
+    int row_;
+    int column_;
+};
+
+// Returns the position of every image row in the interlaced row order.
+static std::vector<int> getInterlacedRowPositions(const int height)
+{
+    auto positions = std::vector<int>(height);
+    auto position = 0;
+    for (auto pass = 0; pass < interlacePassesCount; ++pass)
+    {
+        for (auto row = interlacePassStarts[pass]; row < height; row += interlacePassSteps[pass])
         {
-            code = clearCode + 2 + (entry - dictionary.cbegin());
-            ++index;
+            positions[row] = position++;
         }
-        else
+    }
+    return positions;
+}
+
+template<typename Iterator>
+static void encodeLzw(Iterator input, const int inputSize, const int minimumCodeSize, const bool adaptiveClearCode,
+                      LzwBitWriter& writer, LzwSubstitutes* const substitutes = nullptr)
+{
+    constexpr auto maximumCodeSize = LzwDictionary::maximumCodeSize;
+    constexpr auto compressionCheckGap = 8192;
+    // Small fluctuations of the ratio are normal on noisy input and rebuilding the dictionary would cost more than
+    // they do.
+    constexpr auto compressionDropTolerance = 0.99;
+
+    const auto clearCode = (1 << minimumCodeSize);
+    const auto endCode = clearCode + 1;
+
+    auto dictionary = LzwDictionary{};
+    auto nextCode = clearCode + 2;
+    auto codeSize = minimumCodeSize + 1;
+
+    const auto addSequence = [&dictionary, substitutes](const int prefix, const int symbol, const int code)
+    {
+        dictionary.insert(prefix, symbol, code);
+        if (substitutes)
+        {
+            substitutes->insert(prefix, symbol);
+        }
+    };
+
+    writer.write(clearCode, codeSize);
+
+    if (inputSize == 0)
+    {
+        writer.write(endCode, codeSize);
+        writer.finish();
+        return;
+    }
+
+    auto resetIndex = 0;
+    auto resetBitsCount = writer.bitsCount();
+    auto nextCompressionCheck = compressionCheckGap;
+    auto bestCompressionRatio = 0.0;
+
+    // The prefix is the code of the longest sequence matched so far. Extending it with the next symbol is a single
+    // table lookup instead of a search over every sequence in the dictionary.
+    auto prefix = static_cast<int>(*input);
+    for (auto index = 1; index < inputSize; ++index)
+    {
+        const auto symbol = static_cast<int>(*++input);
+
+        if (const auto code = dictionary.find(prefix, symbol); code != LzwDictionary::notFound)
+        {
+            prefix = code;
+            continue;
+        }
+
+        // The decoder rebuilds the dictionary from the emitted sequences alone, so a substituted pixel needs nothing
+        // else.
+        if (substitutes)
         {
-            pushBits(output, bitsCount, code, codeSize);
+            if (const auto code = substitutes->find(dictionary, prefix, symbol); code != LzwDictionary::notFound)
+            {
+                prefix = code;
+                continue;
+            }
+        }
+
+        writer.write(prefix, codeSize);
 
-            if ((1 << codeSize) <= clearCode + 2 + static_cast<int>(dictionary.size()))
+        if ((1 << codeSize) <= nextCode)
+        {
+            if (codeSize < maximumCodeSize)
+            {
+                addSequence(prefix, symbol, nextCode++);
+                ++codeSize;
+            }
+            else if (adaptiveClearCode && index >= nextCompressionCheck)
             {
-                if (codeSize < maximumCodeSize)
+                nextCompressionCheck = index + compressionCheckGap;
+
+                const auto compressionRatio = static_cast<double>(index - resetIndex) /
+                                              static_cast<double>(writer.bitsCount() - resetBitsCount);
+                if (compressionRatio >= bestCompressionRatio * compressionDropTolerance)
                 {
-                    dictionary.push_back(std::move(sequence));
-                    ++codeSize;
+                    bestCompressionRatio = std::max(bestCompressionRatio, compressionRatio);
                 }
                 else
                 {
-                    sequence.clear();
+                    writer.write(clearCode, codeSize);
+
+                    dictionary.clear();
+                    if (substitutes)
+                    {
+                        substitutes->clear();
+                    }
+                    nextCode = clearCode + 2;
+                    codeSize = minimumCodeSize + 1;
+
+                    resetIndex = index;
+                    resetBitsCount = writer.bitsCount();
+                    nextCompressionCheck = index + compressionCheckGap;
+                    bestCompressionRatio = 0.0;
                 }
             }
-            else
-            {
-                dictionary.push_back(std::move(sequence));
-            }
         }
+        else
+        {
+            addSequence(prefix, symbol, nextCode++);
+        }
+
+        prefix = symbol;
     }
 
-    if (!sequence.empty())
+    writer.write(prefix, codeSize);
+    writer.write(endCode, codeSize);
+    writer.finish();
+}
+
+template<typename Index>
+std::pair<std::vector<uint8_t>, int> lzw(const std::vector<Index>& input, const int alphabetSize,
+                                         const bool adaptiveClearCode)
+{
+    const auto minimumCodeSize = getMinimumCodeSize(alphabetSize);
+
+    // Byte indexes cannot fall outside a full alphabet, so only narrower alphabets and wider index types pay for the
+    // range check.
+    if (!std::is_same_v<Index, uint8_t> || alphabetSize < 256)
     {
-        pushBits(output, bitsCount, code, codeSize);
+        const auto [minimum, maximum] = std::minmax_element(input.cbegin(), input.cend());
+        if (minimum != input.cend() && (static_cast<int>(*minimum) < 0 || static_cast<int>(*maximum) >= alphabetSize))
+        {
+            THROW(std::invalid_argument, "lzw input symbols must be between 0 and ", alphabetSize - 1, " but found ",
+                  static_cast<int>(*minimum) < 0 ? static_cast<int>(*minimum) : static_cast<int>(*maximum));
+        }
     }
 
-    pushBits(output, bitsCount, endCode, codeSize);
+    auto output = std::vector<uint8_t>{};
+    const auto expectedBytesCount = getExpectedLzwBytesCount(static_cast<int>(input.size()), minimumCodeSize);
+    auto writer = LzwBitWriter{output, false, expectedBytesCount};
+    encodeLzw(input.cbegin(), static_cast<int>(input.size()), minimumCodeSize, adaptiveClearCode, writer);
 
     return {std::move(output), minimumCodeSize};
 }
 
+template std::pair<std::vector<uint8_t>, int> lzw(const std::vector<uint8_t>& input, const int alphabetSize,
+                                                  const bool adaptiveClearCode);
+
+template std::pair<std::vector<uint8_t>, int> lzw(const std::vector<uint16_t>& input, const int alphabetSize,
+                                                  const bool adaptiveClearCode);
+
+template std::pair<std::vector<uint8_t>, int> lzw(const std::vector<int>& input, const int alphabetSize,
+                                                  const bool adaptiveClearCode);
+
 static void writeHeader(std::vector<uint8_t>& bytes)
 {
     const auto signatureAndVersion = {0x47, 0x49, 0x46, 0x38, 0x39, 0x61};
@@ -175,20 +586,11 @@ static void writeAnimationApplicationExtension(std::vector<uint8_t>& bytes, cons
     bytes.push_back(blockTerminator);
 }
 
-enum class DisposalMethod
-{
-    NotSpecified = 0,
-    DoNotDispose = 1,
-    RestoreToBackgroundColor = 2,
-    RestoreToPrevious = 3
-};
-
 static void writeGraphicControlExtension(std::vector<uint8_t>& bytes, const unsigned delayCentiseconds,
-                                         const DisposalMethod disposalMethod)
+                                         const DisposalMethod disposalMethod, const int transparentColorIndex)
 {
     bytes.push_back(extensionIntroducer);
 
-    const auto graphicControlLabel = 0xF9;
     bytes.push_back(graphicControlLabel);
 
     const auto blockSize = 0x04;
@@ -201,23 +603,23 @@ static void writeGraphicControlExtension(std::vector<uint8_t>& bytes, const unsi
     // +----------+-----------------+-----------------+------------------------+
     const auto disposal = static_cast<int>(disposalMethod);
     const auto userInput = false;
-    const auto transparentColor = false;
+    const auto transparentColor = transparentColorIndex != noTransparentColor;
     const auto packedFields = (disposal << 2) | (userInput << 1) | transparentColor;
     bytes.push_back(packedFields);
 
     bytes.push_back((delayCentiseconds >> 0) & 0xFF);
     bytes.push_back((delayCentiseconds >> 8) & 0xFF);
 
-    const auto transparentBackgroundColorIndex = 0x00;
+    const auto transparentBackgroundColorIndex = transparentColor ? transparentColorIndex : 0x00;
     bytes.push_back(transparentBackgroundColorIndex);
 
     bytes.push_back(blockTerminator);
 }
 
 static void writeImageDescriptor(std::vector<uint8_t>& bytes, const unsigned x0, const unsigned y0,
-                                 const unsigned width, const unsigned height, const int localColorTableSize)
+                                 const unsigned width, const unsigned height, const int localColorTableSize,
+                                 const bool isInterlaced)
 {
-    const auto imageDescriptorLabel = 0x2C;
     bytes.push_back(imageDescriptorLabel);
 
     bytes.push_back((x0 >> 0) & 0xFF);
@@ -238,7 +640,6 @@ static void writeImageDescriptor(std::vector<uint8_t>& bytes, const unsigned x0,
     // | 0                      | 0              | 0           | 00       | 000                    |
     // +------------------------+----------------+-------------+----------+------------------------+
     const auto hasLocalColorTable = localColorTableSize > 0;
-    const auto isInterlaced = false;
     const auto hasSortedColors = false;
 
     auto localColorTableSizeField = 0;
@@ -278,195 +679,2100 @@ static void writeColorTable(std::vector<uint8_t>& bytes, const std::vector<Color
     }
 }
 
-static void writeImageData(std::vector<uint8_t>& bytes, const std::vector<int>& indexes, const int codeSize)
+// When a sink buffer is given, bytes must be its buffer and the completed sub-blocks are flushed as they fill it.
+// The palette is the color table the indexes refer to, which lossy compression needs to tell how far apart they are.
+static void writeImageData(std::vector<uint8_t>& bytes, const std::vector<uint8_t>& indexes, const int width,
+                           const std::vector<Color>& palette, const int transparentIndex, const GifOptions& options,
+                           SinkBuffer* const sinkBuffer = nullptr)
 {
-    const auto output = lzw(indexes, codeSize);
-    const auto& lzwOutput = output.first;
-    const auto minimumCodeSize = output.second;
-    const auto lzwOutputSize = static_cast<int>(lzwOutput.size());
+    const auto minimumCodeSize = getMinimumCodeSize(static_cast<int>(palette.size()));
 
     bytes.push_back(minimumCodeSize);
 
-    auto blockStart = 0;
-    while (blockStart < lzwOutputSize)
-    {
-        const auto count = std::min(maximumDataSubBlockSize, lzwOutputSize - blockStart);
-
-        bytes.push_back(count);
-
-        for (auto index = 0; index < count; ++index)
-        {
-            bytes.push_back(lzwOutput[blockStart + index]);
-        }
+    const auto lossiness = options.lossiness;
+    const auto substitutes =
+        lossiness > 0 ? std::make_unique<LzwSubstitutes>(palette, lossiness, transparentIndex) : nullptr;
 
-        blockStart += count;
+    const auto expectedBytesCount = getExpectedLzwBytesCount(static_cast<int>(indexes.size()), minimumCodeSize);
+    auto writer = LzwBitWriter{bytes, true, expectedBytesCount, sinkBuffer};
+    const auto indexesCount = static_cast<int>(indexes.size());
+    if (options.interlaced && indexesCount > 0)
+    {
+        const auto input = InterlacedIterator{indexes.data(), width, indexesCount / width};
+        encodeLzw(input, indexesCount, minimumCodeSize, options.adaptiveClearCode, writer, substitutes.get());
+    }
+    else
+    {
+        encodeLzw(indexes.cbegin(), indexesCount, minimumCodeSize, options.adaptiveClearCode, writer,
+                  substitutes.get());
     }
 
     bytes.push_back(blockTerminator);
 }
 
-static std::pair<std::vector<Color>, std::vector<int>> getImageColors(const Image& image, const int x0, const int y0,
-                                                                      const int width, const int height)
+// Maps colors to their palette index with open addressing on the color code, so looking up a color costs the same
+// however many colors there are.
+class ColorIndexTable
 {
-    auto colors = std::vector<Color>{};
-    auto indexes = std::vector<int>{};
+public:
+    static constexpr auto notFound = -1;
 
-    const auto widthBound = std::min(x0 + width, image.width());
-    const auto heightBound = std::min(y0 + height, image.height());
-    for (auto y = y0; y < heightBound; ++y)
+    ColorIndexTable() : codes_(initialCapacity), indexes_(initialCapacity, notFound), size_{0}
     {
-        for (auto x = x0; x < widthBound; ++x)
+    }
+
+    int find(const Color color) const
+    {
+        const auto code = color.code();
+        const auto mask = codes_.size() - 1;
+        for (auto slot = hash(code) & mask;; slot = (slot + 1) & mask)
         {
-            const auto color = image(x, y);
-            const auto position = std::find(colors.cbegin(), colors.cend(), color);
-            indexes.push_back(position - colors.cbegin());
-            if (position == colors.cend())
+            if (indexes_[slot] == notFound || codes_[slot] == code)
             {
-                colors.push_back(color);
+                return indexes_[slot];
             }
         }
     }
 
-    if (static_cast<int>(colors.size()) > maximumColorsPerTable)
+    // Returns the index of the color, inserting it with the given index if it is missing.
+    std::pair<int, bool> insert(const Color color, const int index)
     {
-        auto reducedColors = std::vector<Color>{};
-        auto reducedIndexes = std::vector<int>{};
-
-        const auto redSamples = 4;
-        const auto greenSamples = 8;
-        const auto blueSamples = 8;
-
-        const auto channelDepth = 255.0f;
-
-        const auto redSampling = channelDepth / (redSamples - 1);
-        const auto greenSampling = channelDepth / (greenSamples - 1);
-        const auto blueSampling = channelDepth / (blueSamples - 1);
-
-        for (const auto index : indexes)
+        if (2 * (size_ + 1) > static_cast<int>(codes_.size()))
         {
-            const auto color = colors[index];
-            const auto red = static_cast<Color::value_type>(std::round(color.red() / redSampling) * redSampling);
-            const auto green =
-                static_cast<Color::value_type>(std::round(color.green() / greenSampling) * greenSampling);
-            const auto blue = static_cast<Color::value_type>(std::round(color.blue() / blueSampling) * blueSampling);
-            const auto reducedColor = Color{red, green, blue};
+            grow();
+        }
 
-            const auto position = std::find(reducedColors.cbegin(), reducedColors.cend(), reducedColor);
-            reducedIndexes.push_back(position - reducedColors.cbegin());
-            if (position == reducedColors.cend())
+        const auto code = color.code();
+        const auto mask = codes_.size() - 1;
+        auto slot = hash(code) & mask;
+        while (indexes_[slot] != notFound)
+        {
+            if (codes_[slot] == code)
             {
-                reducedColors.push_back(reducedColor);
+                return {indexes_[slot], false};
             }
+            slot = (slot + 1) & mask;
         }
 
-        colors = std::move(reducedColors);
-        indexes = std::move(reducedIndexes);
+        codes_[slot] = code;
+        indexes_[slot] = index;
+        ++size_;
+        return {index, true};
     }
 
-    while (colors.size() < minimumColorsPerTable)
+    void assign(const Color color, const int index)
     {
-        colors.push_back(Colors::black);
+        const auto code = color.code();
+        const auto mask = codes_.size() - 1;
+        auto slot = hash(code) & mask;
+        while (indexes_[slot] != notFound && codes_[slot] != code)
+        {
+            slot = (slot + 1) & mask;
+        }
+        indexes_[slot] = index;
     }
 
-    return {std::move(colors), std::move(indexes)};
-}
-
-std::vector<uint8_t> getGifBinary(const Image& image)
-{
-    LOG_DEBUG("generating gif image binary");
+private:
+    static constexpr auto initialCapacity = 1024;
 
-    if (image.empty())
+    static size_t hash(const uint32_t code)
     {
-        THROW(std::invalid_argument, "gif image cannot be empty");
+        return static_cast<size_t>((code * 2654435761U) ^ (code >> 15));
     }
 
-    auto bytes = std::vector<uint8_t>{};
-
-    writeHeader(bytes);
-
-    const auto globalColorsCount = 0;
-
-    writeLogicalScreen(bytes, image.width(), image.height(), globalColorsCount);
-
-    const auto x0 = 0;
-    const auto y0 = 0;
-    const auto [colors, indexes] = getImageColors(image, x0, y0, image.width(), image.height());
-    const auto localColorsCount = static_cast<int>(colors.size());
+    void grow()
+    {
+        auto codes = std::vector<uint32_t>(2 * codes_.size());
+        auto indexes = std::vector<int32_t>(2 * codes_.size(), notFound);
+        const auto mask = codes.size() - 1;
 
-    writeImageDescriptor(bytes, x0, y0, image.width(), image.height(), localColorsCount);
-    writeColorTable(bytes, colors);
-    writeImageData(bytes, indexes, localColorsCount);
+        for (auto slot = 0; slot < static_cast<int>(codes_.size()); ++slot)
+        {
+            if (indexes_[slot] != notFound)
+            {
+                auto newSlot = hash(codes_[slot]) & mask;
+                while (indexes[newSlot] != notFound)
+                {
+                    newSlot = (newSlot + 1) & mask;
+                }
+                codes[newSlot] = codes_[slot];
+                indexes[newSlot] = indexes_[slot];
+            }
+        }
 
-    bytes.push_back(trailer);
+        codes_ = std::move(codes);
+        indexes_ = std::move(indexes);
+    }
 
-    return bytes;
-}
+    std::vector<uint32_t> codes_;
+    std::vector<int32_t> indexes_;
+    int size_;
+};
 
-std::vector<uint8_t> getGifBinary(const std::vector<const Image*>& frames, const int periodCentiseconds)
+// Colors are reduced to a uniform grid of 4 reds, 8 greens and 8 blues, which gives at most 256 reduced colors. A grid
+// cell is found with one table lookup per channel.
+class ColorReducer
 {
-    LOG_DEBUG("generating gif animation binary with ", frames.size(), " frames and ", periodCentiseconds, " cs period");
+public:
+    static constexpr auto redSamples = 4;
+    static constexpr auto greenSamples = 8;
+    static constexpr auto blueSamples = 8;
+    static constexpr auto cellsCount = redSamples * greenSamples * blueSamples;
 
-    if (frames.empty())
+    ColorReducer() : colors_(cellsCount)
     {
-        THROW(std::invalid_argument, "gif animation frames cannot be empty");
-    }
-
-    auto bytes = std::vector<uint8_t>{};
-
-    writeHeader(bytes);
-
-    const auto width = frames.front()->width();
-    const auto height = frames.front()->height();
-    const auto globalColorsCount = 0;
+        const auto channelDepth = 255.0f;
 
-    writeLogicalScreen(bytes, width, height, globalColorsCount);
-    writeAnimationApplicationExtension(bytes);
+        const auto redSampling = channelDepth / (redSamples - 1);
+        const auto greenSampling = channelDepth / (greenSamples - 1);
+        const auto blueSampling = channelDepth / (blueSamples - 1);
 
-    for (const auto frame : frames)
-    {
-        if (!frame)
+        for (auto value = 0; value <= Color::channelDepth; ++value)
         {
-            THROW(std::invalid_argument, "gif animation frame cannot be null");
+            redCells_[value] = static_cast<uint8_t>(std::round(value / redSampling));
+            greenCells_[value] = static_cast<uint8_t>(std::round(value / greenSampling));
+            blueCells_[value] = static_cast<uint8_t>(std::round(value / blueSampling));
         }
 
-        if (frame->empty())
+        for (auto red = 0; red < redSamples; ++red)
         {
-            THROW(std::invalid_argument, "gif animation frame cannot be empty");
+            for (auto green = 0; green < greenSamples; ++green)
+            {
+                for (auto blue = 0; blue < blueSamples; ++blue)
+                {
+                    colors_[(red * greenSamples + green) * blueSamples + blue] =
+                        Color{static_cast<Color::value_type>(red * redSampling),
+                              static_cast<Color::value_type>(green * greenSampling),
+                              static_cast<Color::value_type>(blue * blueSampling)};
+                }
+            }
         }
+    }
 
-        if (frame->width() != width || frame->height() != height)
+    int cell(const Color color) const
+    {
+        return (redCells_[color.red()] * greenSamples + greenCells_[color.green()]) * blueSamples +
+               blueCells_[color.blue()];
+    }
+
+    Color color(const int cell) const
+    {
+        return colors_[cell];
+    }
+
+    const std::vector<Color>& colors() const
+    {
+        return colors_;
+    }
+
+private:
+    uint8_t redCells_[Color::channelDepth + 1];
+    uint8_t greenCells_[Color::channelDepth + 1];
+    uint8_t blueCells_[Color::channelDepth + 1];
+    std::vector<Color> colors_;
+};
+
+static const ColorReducer& getColorReducer()
+{
+    static const auto reducer = ColorReducer{};
+    return reducer;
+}
+
+static int getPoolSize(const int threadsCount)
+{
+    const auto hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+    return threadsCount > 0 ? threadsCount : std::max(hardwareThreads, 1);
+}
+
+// Runs the work items on a pool of threads that pick the next unclaimed index, so uneven items still balance out. The
+// first exception in index order is rethrown once every thread has finished.
+template<typename Work>
+static void parallelFor(const int count, const int threadsCount, Work&& work)
+{
+    const auto poolSize = std::min(count, getPoolSize(threadsCount));
+
+    if (poolSize <= 1)
+    {
+        for (auto index = 0; index < count; ++index)
+        {
+            work(index);
+        }
+        return;
+    }
+
+    auto nextIndex = std::atomic<int>{0};
+    auto exceptions = std::vector<std::exception_ptr>(count);
+
+    const auto worker = [&]()
+    {
+        for (auto index = nextIndex++; index < count; index = nextIndex++)
+        {
+            try
+            {
+                work(index);
+            }
+            catch (...)
+            {
+                exceptions[index] = std::current_exception();
+            }
+        }
+    };
+
+    auto threads = std::vector<std::thread>{};
+    for (auto thread = 1; thread < poolSize; ++thread)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto& exception : exceptions)
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+}
+
+static std::vector<Color> getQuantizedPalette(const Quantizer quantizer, const ColorHistogram& histogram,
+                                              const int colorsCount)
+{
+    switch (quantizer)
+    {
+    case Quantizer::MedianCut:
+        return getMedianCutPalette(histogram, colorsCount);
+    case Quantizer::Octree:
+        return getOctreePalette(histogram, colorsCount);
+    default:
+        THROW(std::invalid_argument, "quantizer ", static_cast<int>(quantizer), " does not build palettes");
+    }
+}
+
+// How far dithering may push each channel, which is roughly the distance between neighbouring palette colors.
+struct DitheringSpread
+{
+    int red;
+    int green;
+    int blue;
+};
+
+static DitheringSpread getUniformDitheringSpread()
+{
+    return {Color::channelDepth / (ColorReducer::redSamples - 1),
+            Color::channelDepth / (ColorReducer::greenSamples - 1),
+            Color::channelDepth / (ColorReducer::blueSamples - 1)};
+}
+
+static DitheringSpread getPaletteDitheringSpread(const int colorsCount)
+{
+    const auto spread = static_cast<int>(Color::channelDepth / std::cbrt(std::max(colorsCount, 2)));
+    return {spread, spread, spread};
+}
+
+static Color::value_type clampChannel(const int value)
+{
+    return static_cast<Color::value_type>(std::clamp(value, 0, static_cast<int>(Color::channelDepth)));
+}
+
+// Maps the changed pixels of the region to palette indexes. Floyd-Steinberg carries the error of each pixel over to
+// its right and lower neighbours, keeping only two rows of error around. Ordered dithering offsets every pixel by an
+// 8x8 Bayer matrix instead, which does not depend on other pixels, so runs of rows are offset and looked up in
+// parallel. Every run works on its own copy of mapColor, which must give the same index wherever it is called, so
+// lookups that cache their results never share them between threads.
+template<typename IsUnchanged, typename MapColor>
+static void mapRegionColors(const Image& image, const int x0, const int y0, const int widthBound, const int heightBound,
+                            const IsUnchanged& isUnchanged, const std::vector<Color>& colors,
+                            const MapColor& mapColor, const Dithering dithering, const DitheringSpread spread,
+                            const int threadsCount, std::vector<uint8_t>& indexes)
+{
+    const auto regionWidth = std::max(widthBound - x0, 0);
+    const auto regionHeight = std::max(heightBound - y0, 0);
+
+    if (dithering == Dithering::FloydSteinberg)
+    {
+        auto lookup = mapColor;
+
+        // Errors are kept in sixteenths, with one padding slot on each side of the row.
+        auto currentErrors = std::vector<int>(3 * (regionWidth + 2));
+        auto nextErrors = std::vector<int>(3 * (regionWidth + 2));
+
+        auto index = indexes.begin();
+        for (auto y = y0; y < heightBound; ++y)
+        {
+            std::fill(nextErrors.begin(), nextErrors.end(), 0);
+
+            auto error = currentErrors.begin() + 3;
+            auto nextError = nextErrors.begin() + 3;
+            for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound;
+                 ++offset, ++index, error += 3, nextError += 3)
+            {
+                if (isUnchanged(offset))
+                {
+                    continue;
+                }
+
+                const auto color = image.cbegin()[offset];
+                const auto adjusted = Color{clampChannel(color.red() + error[0] / 16),
+                                            clampChannel(color.green() + error[1] / 16),
+                                            clampChannel(color.blue() + error[2] / 16)};
+                const auto colorIndex = lookup(adjusted);
+                const auto mapped = colors[colorIndex];
+                *index = static_cast<uint8_t>(colorIndex);
+
+                const int channelErrors[] = {adjusted.red() - mapped.red(), adjusted.green() - mapped.green(),
+                                             adjusted.blue() - mapped.blue()};
+                for (auto channel = 0; channel < 3; ++channel)
+                {
+                    error[channel + 3] += 7 * channelErrors[channel];
+                    nextError[channel - 3] += 3 * channelErrors[channel];
+                    nextError[channel] += 5 * channelErrors[channel];
+                    nextError[channel + 3] += channelErrors[channel];
+                }
+            }
+
+            std::swap(currentErrors, nextErrors);
+        }
+    }
+    else if (dithering == Dithering::Ordered)
+    {
+        constexpr int bayerMatrix[8][8] = {{0, 32, 8, 40, 2, 34, 10, 42},  {48, 16, 56, 24, 50, 18, 58, 26},
+                                           {12, 44, 4, 36, 14, 46, 6, 38}, {60, 28, 52, 20, 62, 30, 54, 22},
+                                           {3, 35, 11, 43, 1, 33, 9, 41},  {51, 19, 59, 27, 49, 17, 57, 25},
+                                           {15, 47, 7, 39, 13, 45, 5, 37}, {63, 31, 55, 23, 61, 29, 53, 21}};
+
+        const auto runsCount = std::min(regionHeight, getPoolSize(threadsCount));
+        parallelFor(runsCount, threadsCount,
+                    [&](const int run)
+                    {
+                        auto lookup = mapColor;
+                        const auto rowsBegin = y0 + regionHeight * run / runsCount;
+                        const auto rowsEnd = y0 + regionHeight * (run + 1) / runsCount;
+                        for (auto y = rowsBegin; y < rowsEnd; ++y)
+                        {
+                            // Thresholds are centered on zero and span one spread.
+                            DitheringSpread offsets[8];
+                            for (auto column = 0; column < 8; ++column)
+                            {
+                                const auto threshold = 2 * bayerMatrix[y & 7][column] + 1 - 64;
+                                offsets[column] = {threshold * spread.red / 128, threshold * spread.green / 128,
+                                                   threshold * spread.blue / 128};
+                            }
+
+                            auto index = indexes.begin() + (y - y0) * regionWidth;
+                            for (auto x = x0; x < widthBound; ++x, ++index)
+                            {
+                                const auto offset = y * image.width() + x;
+                                if (isUnchanged(offset))
+                                {
+                                    continue;
+                                }
+
+                                const auto color = image.cbegin()[offset];
+                                const auto& colorOffset = offsets[x & 7];
+                                const auto adjusted = Color{clampChannel(color.red() + colorOffset.red),
+                                                            clampChannel(color.green() + colorOffset.green),
+                                                            clampChannel(color.blue() + colorOffset.blue)};
+                                *index = static_cast<uint8_t>(lookup(adjusted));
+                            }
+                        }
+                    });
+    }
+    else
+    {
+        auto lookup = mapColor;
+
+        auto index = indexes.begin();
+        for (auto y = y0; y < heightBound; ++y)
+        {
+            for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound; ++offset, ++index)
+            {
+                if (!isUnchanged(offset))
+                {
+                    *index = static_cast<uint8_t>(lookup(image.cbegin()[offset]));
+                }
+            }
+        }
+    }
+}
+
+static bool isTransparentPixel(const Color color, const int alphaThreshold)
+{
+    return color.alpha() < alphaThreshold;
+}
+
+// The palette only holds the color channels, so colors differing in alpha alone share one entry.
+static Color getOpaqueColor(const Color color)
+{
+    return Color{color.red(), color.green(), color.blue()};
+}
+
+static bool isSamePixel(const Color lhs, const Color rhs, const int alphaThreshold)
+{
+    return lhs == rhs || (isTransparentPixel(lhs, alphaThreshold) && isTransparentPixel(rhs, alphaThreshold));
+}
+
+// Transparent pixels and pixels matching the previous frame, if one is given, are mapped to an extra transparent
+// color. When the palette has no room left for it, the region is encoded with its actual colors instead, and the
+// palette keeps room for it from the start if the region has transparent pixels. Colors keep the order they are first
+// seen in, since LZW only compares indexes for equality and reordering the palette cannot change the output size.
+static std::tuple<std::vector<Color>, std::vector<uint8_t>, int>
+getImageColors(const Image& image, const Image* previous, const int x0, const int y0, const int width,
+               const int height, const GifOptions& options, const int threadsCount)
+{
+    const auto widthBound = std::min(x0 + width, image.width());
+    const auto heightBound = std::min(y0 + height, image.height());
+    const auto regionWidth = std::max(widthBound - x0, 0);
+    const auto regionHeight = std::max(heightBound - y0, 0);
+    const auto alphaThreshold = options.alphaThreshold;
+
+    const auto isUnchanged = [&image, previous, alphaThreshold](const int offset)
+    {
+        const auto color = image.cbegin()[offset];
+        return isTransparentPixel(color, alphaThreshold) || (previous && previous->cbegin()[offset] == color);
+    };
+
+    auto hasTransparentPixels = false;
+    for (auto y = y0; y < heightBound && alphaThreshold > 0 && !hasTransparentPixels; ++y)
+    {
+        const auto row = image.cbegin() + y * image.width();
+        hasTransparentPixels = std::any_of(row + x0, row + widthBound, [alphaThreshold](const Color color)
+                                           { return isTransparentPixel(color, alphaThreshold); });
+    }
+
+    auto colors = std::vector<Color>{};
+    auto indexes = std::vector<uint8_t>(regionWidth * regionHeight);
+    auto hasUnchangedPixels = false;
+    auto isReduced = false;
+    auto quantizer = options.quantizer;
+    const auto reservedColorsCount = hasTransparentPixels ? 1 : 0;
+
+    // The first pass stops as soon as the palette overflows, so the reduction passes keep looking for unchanged pixels.
+    const auto isUnchangedReducedPixel = [&](const int offset)
+    {
+        const auto unchanged = isUnchanged(offset);
+        hasUnchangedPixels = hasUnchangedPixels || unchanged;
+        return unchanged;
+    };
+
+    auto table = ColorIndexTable{};
+    auto index = indexes.begin();
+    for (auto y = y0; y < heightBound && !isReduced; ++y)
+    {
+        for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound; ++offset, ++index)
+        {
+            if (isUnchanged(offset))
+            {
+                hasUnchangedPixels = true;
+                continue;
+            }
+
+            const auto color = getOpaqueColor(image.cbegin()[offset]);
+            const auto [colorIndex, inserted] = table.insert(color, static_cast<int>(colors.size()));
+            if (inserted)
+            {
+                if (static_cast<int>(colors.size()) == maximumColorsPerTable - reservedColorsCount)
+                {
+                    isReduced = true;
+                    break;
+                }
+                colors.push_back(color);
+            }
+            *index = static_cast<uint8_t>(colorIndex);
+        }
+    }
+
+    if (isReduced && quantizer == Quantizer::Uniform)
+    {
+        const auto& reducer = getColorReducer();
+        const auto mapColor = [&reducer](const Color color) { return reducer.cell(color); };
+
+        mapRegionColors(image, x0, y0, widthBound, heightBound, isUnchanged, reducer.colors(), mapColor,
+                        options.dithering, getUniformDitheringSpread(), threadsCount, indexes);
+
+        // Pixels are mapped to grid cells first, and the palette then keeps the cells in use in the order they appear.
+        int cellIndexes[ColorReducer::cellsCount];
+        std::fill(std::begin(cellIndexes), std::end(cellIndexes), -1);
+
+        colors.clear();
+        index = indexes.begin();
+        for (auto y = y0; y < heightBound; ++y)
+        {
+            for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound; ++offset, ++index)
+            {
+                if (isUnchangedReducedPixel(offset))
+                {
+                    continue;
+                }
+
+                const auto cell = *index;
+                if (cellIndexes[cell] < 0)
+                {
+                    cellIndexes[cell] = static_cast<int>(colors.size());
+                    colors.push_back(reducer.color(cell));
+                }
+                *index = static_cast<uint8_t>(cellIndexes[cell]);
+            }
+        }
+
+        // Transparent pixels cannot be left out like unchanged ones, so a full grid is quantized instead.
+        if (hasTransparentPixels && static_cast<int>(colors.size()) >= maximumColorsPerTable)
+        {
+            quantizer = Quantizer::MedianCut;
+        }
+    }
+
+    if (isReduced && quantizer != Quantizer::Uniform)
+    {
+        auto histogram = ColorHistogram{};
+        for (auto y = y0; y < heightBound; ++y)
+        {
+            for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound; ++offset)
+            {
+                if (!isUnchangedReducedPixel(offset))
+                {
+                    histogram.add(image.cbegin()[offset]);
+                }
+            }
+        }
+
+        const auto quantizedColorsCount = hasUnchangedPixels ? maximumColorsPerTable - 1 : maximumColorsPerTable;
+        colors = getQuantizedPalette(quantizer, histogram, quantizedColorsCount);
+
+        auto inversePalette = InversePalette{colors};
+        mapRegionColors(image, x0, y0, widthBound, heightBound, isUnchanged, colors, inversePalette, options.dithering,
+                        getPaletteDitheringSpread(static_cast<int>(colors.size())), threadsCount, indexes);
+    }
+
+    auto transparentIndex = noTransparentColor;
+    if (hasUnchangedPixels)
+    {
+        if (static_cast<int>(colors.size()) >= maximumColorsPerTable)
+        {
+            return getImageColors(image, nullptr, x0, y0, width, height, options, threadsCount);
+        }
+
+        transparentIndex = static_cast<int>(colors.size());
+        colors.push_back(Colors::black);
+
+        index = indexes.begin();
+        for (auto y = y0; y < heightBound; ++y)
+        {
+            for (auto offset = y * image.width() + x0; offset < y * image.width() + widthBound; ++offset, ++index)
+            {
+                if (isUnchanged(offset))
+                {
+                    *index = static_cast<uint8_t>(transparentIndex);
+                }
+            }
+        }
+    }
+
+    while (colors.size() < minimumColorsPerTable)
+    {
+        colors.push_back(Colors::black);
+    }
+
+    return {std::move(colors), std::move(indexes), transparentIndex};
+}
+
+struct GlobalColorTable
+{
+    std::vector<Color> colors;
+    ColorIndexTable indexes;
+    int transparentIndex;
+    bool isReduced;
+};
+
+// The distinct colors of a run of rows in the order they first appear, along with how often each of them does.
+struct ColorCounts
+{
+    std::vector<Color> colors;
+    std::vector<uint64_t> counts;
+    bool hasTransparentPixels;
+};
+
+static void countColors(const Image& frame, const int rowsBegin, const int rowsEnd, const int alphaThreshold,
+                        ColorCounts& colorCounts)
+{
+    colorCounts.colors.clear();
+    colorCounts.counts.clear();
+    colorCounts.hasTransparentPixels = false;
+
+    auto indexes = ColorIndexTable{};
+    for (auto pixel = frame.cbegin() + rowsBegin * frame.width(); pixel != frame.cbegin() + rowsEnd * frame.width();
+         ++pixel)
+    {
+        if (isTransparentPixel(*pixel, alphaThreshold))
+        {
+            colorCounts.hasTransparentPixels = true;
+            continue;
+        }
+
+        const auto color = getOpaqueColor(*pixel);
+        const auto [index, inserted] = indexes.insert(color, static_cast<int>(colorCounts.colors.size()));
+        if (inserted)
+        {
+            colorCounts.colors.push_back(color);
+            colorCounts.counts.push_back(1);
+        }
+        else
+        {
+            ++colorCounts.counts[index];
+        }
+    }
+}
+
+// Builds one color table from every frameStride-th frame. The rows are counted in chunks on the thread pool and the
+// chunks are merged in order, so the table is the same for any number of threads. Colors are reduced the same way as
+// for local color tables when there are too many of them, and one entry is kept for transparency if delta frames or
+// transparent pixels of the sampled frames need it and there is room.
+static GlobalColorTable getGlobalColorTable(const std::vector<const Image*>& frames, const int frameStride,
+                                            bool reserveTransparentColor, const GifOptions& options)
+{
+    constexpr auto chunkPixelsCount = 1 << 16;
+
+    const auto quantizer = options.quantizer;
+
+    auto chunks = std::vector<std::tuple<const Image*, int, int>>{};
+    for (auto frame = 0; frame < static_cast<int>(frames.size()); frame += std::max(frameStride, 1))
+    {
+        const auto height = frames[frame]->height();
+        const auto chunkRowsCount = std::max(chunkPixelsCount / std::max(frames[frame]->width(), 1), 1);
+        for (auto row = 0; row < height; row += chunkRowsCount)
+        {
+            chunks.push_back({frames[frame], row, std::min(row + chunkRowsCount, height)});
+        }
+    }
+
+    auto table = GlobalColorTable{{}, {}, noTransparentColor, false};
+    auto counts = std::vector<uint64_t>{};
+
+    // Only a batch of chunks is counted at a time, which bounds the memory held by their colors.
+    const auto chunksCount = static_cast<int>(chunks.size());
+    const auto batchSize = std::max(std::min(getPoolSize(options.threadsCount), chunksCount), 1);
+    auto chunkColors = std::vector<ColorCounts>(batchSize);
+    for (auto batchStart = 0; batchStart < chunksCount; batchStart += batchSize)
+    {
+        const auto batchChunksCount = std::min(batchSize, chunksCount - batchStart);
+        parallelFor(batchChunksCount, batchSize,
+                    [&](const int offset)
+                    {
+                        const auto [frame, rowsBegin, rowsEnd] = chunks[batchStart + offset];
+                        countColors(*frame, rowsBegin, rowsEnd, options.alphaThreshold, chunkColors[offset]);
+                    });
+
+        for (auto offset = 0; offset < batchChunksCount; ++offset)
+        {
+            const auto& colorCounts = chunkColors[offset];
+            reserveTransparentColor = reserveTransparentColor || colorCounts.hasTransparentPixels;
+            for (auto color = 0; color < static_cast<int>(colorCounts.colors.size()); ++color)
+            {
+                const auto [index, inserted] =
+                    table.indexes.insert(colorCounts.colors[color], static_cast<int>(table.colors.size()));
+                if (inserted)
+                {
+                    table.colors.push_back(colorCounts.colors[color]);
+                    counts.push_back(colorCounts.counts[color]);
+                }
+                else
+                {
+                    counts[index] += colorCounts.counts[color];
+                }
+            }
+        }
+    }
+
+    const auto reservedColorsCount = reserveTransparentColor ? 1 : 0;
+    if (static_cast<int>(table.colors.size()) > maximumColorsPerTable - reservedColorsCount &&
+        quantizer != Quantizer::Uniform)
+    {
+        auto histogram = ColorHistogram{};
+        for (auto color = 0; color < static_cast<int>(table.colors.size()); ++color)
+        {
+            histogram.add(table.colors[color], counts[color]);
+        }
+
+        auto reducedColors = getQuantizedPalette(quantizer, histogram, maximumColorsPerTable - reservedColorsCount);
+        auto inversePalette = InversePalette{reducedColors};
+        for (const auto color : table.colors)
+        {
+            table.indexes.assign(color, inversePalette(color));
+        }
+
+        table.colors = std::move(reducedColors);
+        table.isReduced = true;
+    }
+    else if (static_cast<int>(table.colors.size()) > maximumColorsPerTable - reservedColorsCount)
+    {
+        const auto& reducer = getColorReducer();
+
+        int cellIndexes[ColorReducer::cellsCount];
+        std::fill(std::begin(cellIndexes), std::end(cellIndexes), -1);
+
+        auto reducedColors = std::vector<Color>{};
+        for (const auto color : table.colors)
+        {
+            const auto cell = reducer.cell(color);
+            if (cellIndexes[cell] < 0)
+            {
+                cellIndexes[cell] = static_cast<int>(reducedColors.size());
+                reducedColors.push_back(reducer.color(cell));
+            }
+            table.indexes.assign(color, cellIndexes[cell]);
+        }
+
+        table.colors = std::move(reducedColors);
+        table.isReduced = true;
+    }
+
+    if (reserveTransparentColor && static_cast<int>(table.colors.size()) < maximumColorsPerTable)
+    {
+        table.transparentIndex = static_cast<int>(table.colors.size());
+        table.colors.push_back(Colors::black);
+    }
+
+    while (table.colors.size() < minimumColorsPerTable)
+    {
+        table.colors.push_back(Colors::black);
+    }
+
+    return table;
+}
+
+static int getNearestColorIndex(const std::vector<Color>& colors, const Color color, const int excludedIndex)
+{
+    auto nearestIndex = 0;
+    auto nearestDistance = std::numeric_limits<int>::max();
+    for (auto index = 0; index < static_cast<int>(colors.size()); ++index)
+    {
+        const auto red = colors[index].red() - color.red();
+        const auto green = colors[index].green() - color.green();
+        const auto blue = colors[index].blue() - color.blue();
+        const auto distance = red * red + green * green + blue * blue;
+        if (distance < nearestDistance && index != excludedIndex)
+        {
+            nearestIndex = index;
+            nearestDistance = distance;
+        }
+    }
+    return nearestIndex;
+}
+
+// Maps the region to the global color table. Colors missing from it, which can only come from frames that were not
+// sampled or from dithering, are mapped to the nearest color in the table. So are transparent pixels if the table has
+// no transparent color.
+static std::tuple<std::vector<Color>, std::vector<uint8_t>, int>
+getGlobalColorIndexes(const GlobalColorTable& table, const Image& image, const Image* previous, const int x0,
+                      const int y0, const int width, const int height, const GifOptions& options,
+                      const int threadsCount)
+{
+    const auto alphaThreshold = options.alphaThreshold;
+    const auto transparentIndex = previous || alphaThreshold > 0 ? table.transparentIndex : noTransparentColor;
+
+    const auto widthBound = std::min(x0 + width, image.width());
+    const auto heightBound = std::min(y0 + height, image.height());
+    const auto regionWidth = std::max(widthBound - x0, 0);
+    const auto regionHeight = std::max(heightBound - y0, 0);
+
+    const auto isUnchanged = [&image, previous, transparentIndex, alphaThreshold](const int offset)
+    {
+        const auto color = image.cbegin()[offset];
+        return transparentIndex != noTransparentColor &&
+               (isTransparentPixel(color, alphaThreshold) || (previous && previous->cbegin()[offset] == color));
+    };
+
+    const auto mapColor = [&table, missingColors = ColorIndexTable{}](const Color pixel) mutable
+    {
+        const auto color = getOpaqueColor(pixel);
+        if (const auto index = table.indexes.find(color); index != ColorIndexTable::notFound)
+        {
+            return index;
+        }
+
+        if (const auto missingIndex = missingColors.find(color); missingIndex != ColorIndexTable::notFound)
+        {
+            return missingIndex;
+        }
+
+        const auto nearestIndex = getNearestColorIndex(table.colors, color, table.transparentIndex);
+        missingColors.insert(color, nearestIndex);
+        return nearestIndex;
+    };
+
+    // Only a reduced table loses colors, otherwise every sampled color is matched exactly.
+    const auto dithering = table.isReduced ? options.dithering : Dithering::None;
+    const auto spread = getPaletteDitheringSpread(static_cast<int>(table.colors.size()));
+
+    auto indexes = std::vector<uint8_t>(regionWidth * regionHeight, static_cast<uint8_t>(transparentIndex));
+    mapRegionColors(image, x0, y0, widthBound, heightBound, isUnchanged, table.colors, mapColor, dithering, spread,
+                    threadsCount, indexes);
+
+    return {std::vector<Color>{}, std::move(indexes), transparentIndex};
+}
+
+// Returns the x0, y0, width and height of the smallest region containing every pixel that differs from the previous
+// frame, where transparent pixels are all alike. Identical frames still need an image descriptor, so they get a
+// single pixel region.
+static std::tuple<int, int, int, int> getChangedRegion(const Image& frame, const Image& previous,
+                                                       const int alphaThreshold)
+{
+    const auto isSame = [alphaThreshold](const Color lhs, const Color rhs)
+    { return isSamePixel(lhs, rhs, alphaThreshold); };
+
+    const auto width = frame.width();
+    const auto height = frame.height();
+
+    auto left = width;
+    auto right = -1;
+    auto top = height;
+    auto bottom = -1;
+
+    for (auto y = 0; y < height; ++y)
+    {
+        const auto row = frame.cbegin() + y * width;
+        const auto previousRow = previous.cbegin() + y * width;
+
+        const auto mismatch = std::mismatch(row, row + width, previousRow, isSame);
+        if (mismatch.first == row + width)
+        {
+            continue;
+        }
+
+        auto last = width - 1;
+        while (isSame(row[last], previousRow[last]))
+        {
+            --last;
+        }
+
+        left = std::min(left, static_cast<int>(mismatch.first - row));
+        right = std::max(right, last);
+        top = std::min(top, y);
+        bottom = y;
+    }
+
+    if (right < 0)
+    {
+        return {0, 0, 1, 1};
+    }
+
+    return {left, top, right - left + 1, bottom - top + 1};
+}
+
+// Mixes the pixels eight bytes at a time. Equal hashes are confirmed by comparing the pixels, so collisions only cost
+// that comparison.
+static uint64_t getFrameHash(const Image& frame)
+{
+    constexpr auto multiplier = uint64_t{0x9E3779B97F4A7C15};
+
+    const auto bytes = frame.bytes();
+    const auto bytesCount = frame.size() * sizeof(Color);
+
+    auto hash = static_cast<uint64_t>(bytesCount);
+    auto offset = size_t{0};
+    for (; offset + sizeof(uint64_t) <= bytesCount; offset += sizeof(uint64_t))
+    {
+        auto word = uint64_t{};
+        std::memcpy(&word, bytes + offset, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    for (; offset < bytesCount; ++offset)
+    {
+        hash = (hash ^ bytes[offset]) * multiplier;
+    }
+    return hash;
+}
+
+static bool isSameFrame(const Image& frame, const uint64_t frameHash, const Image& other, const uint64_t otherHash)
+{
+    return frameHash == otherHash && frame.width() == other.width() && frame.height() == other.height() &&
+           std::memcmp(frame.bytes(), other.bytes(), frame.size() * sizeof(Color)) == 0;
+}
+
+static void validateDelay(const int delayCentiseconds)
+{
+    if (delayCentiseconds < 0 || delayCentiseconds > maximumDelayCentiseconds)
+    {
+        THROW(std::invalid_argument, "gif frame delay ", delayCentiseconds, " cs must be between 0 and ",
+              maximumDelayCentiseconds);
+    }
+}
+
+static void validateLoopCount(const int loopCount)
+{
+    if (loopCount > maximumLoopCount)
+    {
+        THROW(std::invalid_argument, "gif loop count ", loopCount, " cannot exceed ", maximumLoopCount);
+    }
+}
+
+// Runs of identical frames collapse into their first frame, shown for the combined delay as long as it fits.
+static void mergeIdenticalFrames(std::vector<const Image*>& frames, std::vector<int>& delaysCentiseconds,
+                                 const int threadsCount)
+{
+    auto hashes = std::vector<uint64_t>(frames.size());
+    parallelFor(static_cast<int>(frames.size()), threadsCount,
+                [&](const int index) { hashes[index] = getFrameHash(*frames[index]); });
+
+    auto mergedCount = 0;
+    for (auto index = 0; index < static_cast<int>(frames.size()); ++index)
+    {
+        if (mergedCount > 0 &&
+            isSameFrame(*frames[index], hashes[index], *frames[mergedCount - 1], hashes[mergedCount - 1]) &&
+            delaysCentiseconds[mergedCount - 1] + delaysCentiseconds[index] <= maximumDelayCentiseconds)
+        {
+            delaysCentiseconds[mergedCount - 1] += delaysCentiseconds[index];
+            continue;
+        }
+
+        frames[mergedCount] = frames[index];
+        hashes[mergedCount] = hashes[index];
+        delaysCentiseconds[mergedCount] = delaysCentiseconds[index];
+        ++mergedCount;
+    }
+
+    frames.resize(mergedCount);
+    delaysCentiseconds.resize(mergedCount);
+}
+
+// A negative loop count leaves out the application extension, so the animation is shown once.
+static void writeAnimationStart(std::vector<uint8_t>& bytes, const int width, const int height,
+                                const GlobalColorTable* globalColorTable, const int loopCount)
+{
+    validateLoopCount(loopCount);
+
+    writeHeader(bytes);
+
+    if (globalColorTable)
+    {
+        writeLogicalScreen(bytes, width, height, static_cast<int>(globalColorTable->colors.size()));
+        writeColorTable(bytes, globalColorTable->colors);
+    }
+    else
+    {
+        const auto globalColorsCount = 0;
+
+        writeLogicalScreen(bytes, width, height, globalColorsCount);
+    }
+
+    if (loopCount >= 0)
+    {
+        writeAnimationApplicationExtension(bytes, static_cast<unsigned>(loopCount));
+    }
+}
+
+// Writes the region of the frame as an image placed at the given screen position plus the region offset.
+static void writeFrameRegion(std::vector<uint8_t>& bytes, const Image& frame, const Image* previous,
+                             const GlobalColorTable* globalColorTable, const int x0, const int y0,
+                             const int regionWidth, const int regionHeight, const int screenX, const int screenY,
+                             const int delayCentiseconds, const DisposalMethod disposalMethod,
+                             const GifOptions& options, const int threadsCount, SinkBuffer* const sinkBuffer)
+{
+    const auto [colors, indexes, transparentIndex] =
+        globalColorTable
+            ? getGlobalColorIndexes(*globalColorTable, frame, previous, x0, y0, regionWidth, regionHeight, options,
+                                    threadsCount)
+            : getImageColors(frame, previous, x0, y0, regionWidth, regionHeight, options, threadsCount);
+    const auto localColorsCount = static_cast<int>(colors.size());
+
+    writeGraphicControlExtension(bytes, delayCentiseconds, disposalMethod, transparentIndex);
+    writeImageDescriptor(bytes, screenX + x0, screenY + y0, regionWidth, regionHeight, localColorsCount,
+                         options.interlaced);
+
+    if (globalColorTable)
+    {
+        writeImageData(bytes, indexes, regionWidth, globalColorTable->colors, transparentIndex, options, sinkBuffer);
+    }
+    else
+    {
+        writeColorTable(bytes, colors);
+        writeImageData(bytes, indexes, regionWidth, colors, transparentIndex, options, sinkBuffer);
+    }
+}
+
+// Frames are encoded in batches of one per thread, so at most that many encoded frames wait to be written. A single
+// thread streams its frame through the sink buffer instead. The threads are already busy with whole frames, so each
+// frame is encoded on a single one.
+template<typename WriteFrame>
+static void writeFramesInBatches(ByteSink& sink, SinkBuffer& buffer, const int framesCount, const int threadsCount,
+                                 WriteFrame&& writeFrame)
+{
+    const auto batchSize = std::min(getPoolSize(threadsCount), framesCount);
+    auto frameBytes = std::vector<std::vector<uint8_t>>(batchSize);
+
+    for (auto batchStart = 0; batchStart < framesCount; batchStart += batchSize)
+    {
+        const auto batchFramesCount = std::min(batchSize, framesCount - batchStart);
+
+        parallelFor(batchFramesCount, batchSize,
+                    [&](const int offset)
+                    {
+                        auto& bytes = batchSize == 1 ? buffer.bytes() : frameBytes[offset];
+                        writeFrame(batchStart + offset, bytes, batchSize == 1 ? &buffer : nullptr);
+                    });
+
+        if (batchSize > 1)
+        {
+            buffer.flush();
+            for (auto offset = 0; offset < batchFramesCount; ++offset)
+            {
+                sink.write(frameBytes[offset]);
+                frameBytes[offset].clear();
+            }
+        }
+    }
+}
+
+static void validateAnimationFrame(const Image& frame, const int width, const int height)
+{
+    if (frame.empty())
+    {
+        THROW(std::invalid_argument, "gif animation frame cannot be empty");
+    }
+
+    if (frame.width() != width || frame.height() != height)
+    {
+        THROW(std::invalid_argument, "gif animation frames do not match in size");
+    }
+}
+
+// A delta frame is drawn over the previous one, so it cannot turn an opaque pixel transparent. The frame before it
+// clears the screen once shown instead, and the next frame is encoded as if it were the first.
+static bool isClearingScreen(const Image& frame, const Image* next, const GifOptions& options)
+{
+    const auto alphaThreshold = options.alphaThreshold;
+    if (!options.deltaFrames || alphaThreshold <= 0 || !next || next->size() != frame.size())
+    {
+        return false;
+    }
+
+    return !std::equal(frame.cbegin(), frame.cend(), next->cbegin(),
+                       [alphaThreshold](const Color color, const Color nextColor)
+                       {
+                           return isTransparentPixel(color, alphaThreshold) ||
+                                  !isTransparentPixel(nextColor, alphaThreshold);
+                       });
+}
+
+// The previous frame is the one shown before this frame, unless it cleared the screen, and the next frame is only
+// needed to tell whether this one has to.
+static void writeAnimationFrame(std::vector<uint8_t>& bytes, const Image& frame, const Image* previous,
+                                const Image* next, const GlobalColorTable* globalColorTable, const int width,
+                                const int height, const int delayCentiseconds, const GifOptions& options,
+                                const int threadsCount, SinkBuffer* const sinkBuffer = nullptr)
+{
+    validateAnimationFrame(frame, width, height);
+
+    auto x0 = 0;
+    auto y0 = 0;
+    auto regionWidth = width;
+    auto regionHeight = height;
+    auto disposalMethod = DisposalMethod::NotSpecified;
+
+    if (options.deltaFrames && isClearingScreen(frame, next, options))
+    {
+        disposalMethod = DisposalMethod::RestoreToBackgroundColor;
+    }
+    else if (options.deltaFrames)
+    {
+        disposalMethod = DisposalMethod::DoNotDispose;
+
+        if (previous)
+        {
+            std::tie(x0, y0, regionWidth, regionHeight) = getChangedRegion(frame, *previous, options.alphaThreshold);
+        }
+    }
+    else if (options.alphaThreshold > 0)
+    {
+        // Every frame covers the whole screen, so clearing it afterwards keeps the transparent pixels of the next
+        // frame from showing this one.
+        disposalMethod = DisposalMethod::RestoreToBackgroundColor;
+    }
+
+    const auto deltaPrevious = options.deltaFrames ? previous : nullptr;
+    const auto screenX = 0;
+    const auto screenY = 0;
+    writeFrameRegion(bytes, frame, deltaPrevious, globalColorTable, x0, y0, regionWidth, regionHeight, screenX, screenY,
+                     delayCentiseconds, disposalMethod, options, threadsCount, sinkBuffer);
+}
+
+// Writes a whole single image file with the palette either as the global color table or as the local one. The graphic
+// control extension is only needed for a transparent color.
+static void writeIndexedGif(ByteSink& sink, const int width, const int height, const std::vector<Color>& palette,
+                            const std::vector<uint8_t>& indexes, const int transparentIndex, const GifOptions& options)
+{
+    auto buffer = SinkBuffer{sink};
+    auto& bytes = buffer.bytes();
+
+    writeHeader(bytes);
+
+    const auto x0 = 0;
+    const auto y0 = 0;
+    const auto colorsCount = static_cast<int>(palette.size());
+    const auto delayCentiseconds = 0;
+
+    if (options.colorTableMode == ColorTableMode::Global)
+    {
+        writeLogicalScreen(bytes, width, height, colorsCount);
+        writeColorTable(bytes, palette);
+
+        if (transparentIndex != noTransparentColor)
+        {
+            writeGraphicControlExtension(bytes, delayCentiseconds, DisposalMethod::NotSpecified, transparentIndex);
+        }
+
+        writeImageDescriptor(bytes, x0, y0, width, height, 0, options.interlaced);
+    }
+    else
+    {
+        const auto globalColorsCount = 0;
+
+        writeLogicalScreen(bytes, width, height, globalColorsCount);
+
+        if (transparentIndex != noTransparentColor)
+        {
+            writeGraphicControlExtension(bytes, delayCentiseconds, DisposalMethod::NotSpecified, transparentIndex);
+        }
+
+        writeImageDescriptor(bytes, x0, y0, width, height, colorsCount, options.interlaced);
+        writeColorTable(bytes, palette);
+    }
+
+    writeImageData(bytes, indexes, width, palette, transparentIndex, options, &buffer);
+
+    bytes.push_back(trailer);
+    buffer.flush();
+}
+
+GifOptions getEffortOptions(const Effort effort)
+{
+    auto options = GifOptions{};
+    options.threadsCount = 0;
+
+    switch (effort)
+    {
+    case Effort::Fastest:
+        break;
+    case Effort::Balanced:
+        options.quantizer = Quantizer::MedianCut;
+        options.deltaFrames = true;
+        options.mergeIdenticalFrames = true;
+        break;
+    case Effort::Smallest:
+        options.quantizer = Quantizer::MedianCut;
+        options.deltaFrames = true;
+        options.mergeIdenticalFrames = true;
+        options.adaptiveClearCode = true;
+        break;
+    default:
+        THROW(std::invalid_argument, "effort ", static_cast<int>(effort), " is not recognized");
+    }
+
+    return options;
+}
+
+// The validation is kept apart from the encoding, so the file writers can check their input before touching the file.
+static void validateImage(const Image& image, const GifOptions& options)
+{
+    if (image.empty())
+    {
+        THROW(std::invalid_argument, "gif image cannot be empty");
+    }
+
+    if (options.bandHeight < 0)
+    {
+        THROW(std::invalid_argument, "gif band height ", options.bandHeight, " cannot be negative");
+    }
+}
+
+static void validateIndexedImage(const IndexedImage& image)
+{
+    if (image.empty())
+    {
+        THROW(std::invalid_argument, "gif image cannot be empty");
+    }
+
+    // The indexes are writable in place, so the palette bound is checked again here.
+    const auto paletteSize = static_cast<int>(image.palette().size());
+    if (const auto maximum = std::max_element(image.cbegin(), image.cend()); *maximum >= paletteSize)
+    {
+        THROW(std::invalid_argument, "index ", static_cast<int>(*maximum), " is outside the palette of size ",
+              paletteSize);
+    }
+}
+
+static void validateAnimation(const std::vector<const Image*>& frames, const std::vector<int>& delaysCentiseconds,
+                              const GifOptions& options)
+{
+    if (frames.empty())
+    {
+        THROW(std::invalid_argument, "gif animation frames cannot be empty");
+    }
+
+    if (frames.size() != delaysCentiseconds.size())
+    {
+        THROW(std::invalid_argument, "gif animation has ", frames.size(), " frames but ", delaysCentiseconds.size(),
+              " delays");
+    }
+
+    for (const auto frame : frames)
+    {
+        if (!frame)
+        {
+            THROW(std::invalid_argument, "gif animation frame cannot be null");
+        }
+
+        validateAnimationFrame(*frame, frames.front()->width(), frames.front()->height());
+    }
+
+    std::for_each(delaysCentiseconds.cbegin(), delaysCentiseconds.cend(), validateDelay);
+    validateLoopCount(options.loopCount);
+}
+
+static void validateFrameDescriptors(const int width, const int height, const std::vector<GifFrame>& frames,
+                                     const GifOptions& options)
+{
+    if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+    {
+        THROW(std::invalid_argument, "gif screen dimensions ", width, "x", height, " are out of range");
+    }
+
+    if (frames.empty())
+    {
+        THROW(std::invalid_argument, "gif animation frames cannot be empty");
+    }
+
+    for (const auto& frame : frames)
+    {
+        if (!frame.image || frame.image->empty())
+        {
+            THROW(std::invalid_argument, "gif animation frame cannot be null or empty");
+        }
+
+        if (frame.x < 0 || frame.y < 0 || frame.x + frame.image->width() > width ||
+            frame.y + frame.image->height() > height)
+        {
+            THROW(std::invalid_argument, "gif animation frame of ", frame.image->width(), "x", frame.image->height(),
+                  " at (", frame.x, ", ", frame.y, ") does not fit the ", width, "x", height, " screen");
+        }
+
+        validateDelay(frame.delayCentiseconds);
+    }
+
+    validateLoopCount(options.loopCount);
+}
+
+void writeGifBinary(ByteSink& sink, const Image& image)
+{
+    writeGifBinary(sink, image, GifOptions{});
+}
+
+// Every band is mapped to the shared global color table and compressed on its own thread, then written as an image of
+// its own in band order, so the output does not depend on the number of threads.
+static void writeBandedGif(ByteSink& sink, const Image& image, const GifOptions& options)
+{
+    const auto table = getGlobalColorTable({&image}, 1, false, options);
+
+    auto buffer = SinkBuffer{sink};
+    auto& bytes = buffer.bytes();
+
+    writeHeader(bytes);
+    writeLogicalScreen(bytes, image.width(), image.height(), static_cast<int>(table.colors.size()));
+    writeColorTable(bytes, table.colors);
+
+    const auto bandHeight = options.bandHeight;
+    const auto bandsCount = (image.height() + bandHeight - 1) / bandHeight;
+    writeFramesInBatches(sink, buffer, bandsCount, options.threadsCount,
+                         [&](const int band, std::vector<uint8_t>& bandBytes, SinkBuffer* const sinkBuffer)
+                         {
+                             const auto previous = nullptr;
+                             const auto x0 = 0;
+                             const auto y0 = band * bandHeight;
+                             const auto screenX = 0;
+                             const auto screenY = 0;
+                             const auto delayCentiseconds = 0;
+                             writeFrameRegion(bandBytes, image, previous, &table, x0, y0, image.width(),
+                                              std::min(bandHeight, image.height() - y0), screenX, screenY,
+                                              delayCentiseconds, DisposalMethod::DoNotDispose, options, 1,
+                                              sinkBuffer);
+                         });
+
+    buffer.bytes().push_back(trailer);
+    buffer.flush();
+}
+
+void writeGifBinary(ByteSink& sink, const Image& image, const GifOptions& options)
+{
+    LOG_DEBUG("generating gif image binary");
+
+    validateImage(image, options);
+
+    if (options.bandHeight > 0 && options.bandHeight < image.height())
+    {
+        writeBandedGif(sink, image, options);
+    }
+    else if (options.colorTableMode == ColorTableMode::Global)
+    {
+        const auto table = getGlobalColorTable({&image}, 1, false, options);
+        const auto [colors, indexes, transparentIndex] = getGlobalColorIndexes(
+            table, image, nullptr, 0, 0, image.width(), image.height(), options, options.threadsCount);
+
+        writeIndexedGif(sink, image.width(), image.height(), table.colors, indexes, transparentIndex, options);
+    }
+    else
+    {
+        const auto [colors, indexes, transparentIndex] =
+            getImageColors(image, nullptr, 0, 0, image.width(), image.height(), options, options.threadsCount);
+
+        writeIndexedGif(sink, image.width(), image.height(), colors, indexes, transparentIndex, options);
+    }
+}
+
+void writeGifBinary(ByteSink& sink, const IndexedImage& image)
+{
+    writeGifBinary(sink, image, GifOptions{});
+}
+
+void writeGifBinary(ByteSink& sink, const IndexedImage& image, const GifOptions& options)
+{
+    LOG_DEBUG("generating gif indexed image binary");
+
+    validateIndexedImage(image);
+
+    if (static_cast<int>(image.palette().size()) >= minimumColorsPerTable)
+    {
+        writeIndexedGif(sink, image.width(), image.height(), image.palette(), image.indexes(), noTransparentColor,
+                        options);
+        return;
+    }
+
+    auto palette = image.palette();
+    palette.resize(minimumColorsPerTable, Colors::black);
+    writeIndexedGif(sink, image.width(), image.height(), palette, image.indexes(), noTransparentColor, options);
+}
+
+void writeGifBinary(ByteSink& sink, const std::vector<const Image*>& frames, const int periodCentiseconds)
+{
+    writeGifBinary(sink, frames, periodCentiseconds, GifOptions{});
+}
+
+void writeGifBinary(ByteSink& sink, const std::vector<const Image*>& frames, const int periodCentiseconds,
+                    const GifOptions& options)
+{
+    writeGifBinary(sink, frames, std::vector<int>(frames.size(), periodCentiseconds), options);
+}
+
+void writeGifBinary(ByteSink& sink, const std::vector<const Image*>& frames,
+                    const std::vector<int>& delaysCentiseconds)
+{
+    writeGifBinary(sink, frames, delaysCentiseconds, GifOptions{});
+}
+
+void writeGifBinary(ByteSink& sink, const std::vector<const Image*>& allFrames,
+                    const std::vector<int>& allDelaysCentiseconds, const GifOptions& options)
+{
+    LOG_DEBUG("generating gif animation binary with ", allFrames.size(), " frames");
+
+    validateAnimation(allFrames, allDelaysCentiseconds, options);
+
+    auto frames = allFrames;
+    auto delaysCentiseconds = allDelaysCentiseconds;
+    if (options.mergeIdenticalFrames)
+    {
+        mergeIdenticalFrames(frames, delaysCentiseconds, options.threadsCount);
+    }
+
+    const auto width = frames.front()->width();
+    const auto height = frames.front()->height();
+
+    auto globalColorTable = std::unique_ptr<GlobalColorTable>{};
+    if (options.colorTableMode == ColorTableMode::Global)
+    {
+        globalColorTable = std::make_unique<GlobalColorTable>(
+            getGlobalColorTable(frames, options.globalColorTableFrameStride, options.deltaFrames, options));
+    }
+
+    auto buffer = SinkBuffer{sink};
+
+    writeAnimationStart(buffer.bytes(), width, height, globalColorTable.get(), options.loopCount);
+
+    const auto framesCount = static_cast<int>(frames.size());
+    writeFramesInBatches(sink, buffer, framesCount, options.threadsCount,
+                         [&](const int index, std::vector<uint8_t>& bytes, SinkBuffer* const sinkBuffer)
+                         {
+                             const auto next = index + 1 < framesCount ? frames[index + 1] : nullptr;
+                             const auto previous =
+                                 index > 0 && !isClearingScreen(*frames[index - 1], frames[index], options)
+                                     ? frames[index - 1]
+                                     : nullptr;
+                             writeAnimationFrame(bytes, *frames[index], previous, next, globalColorTable.get(), width,
+                                                 height, delaysCentiseconds[index], options, 1, sinkBuffer);
+                         });
+
+    buffer.bytes().push_back(trailer);
+    buffer.flush();
+}
+
+void writeGifBinary(ByteSink& sink, const int width, const int height, const std::vector<GifFrame>& frames)
+{
+    writeGifBinary(sink, width, height, frames, GifOptions{});
+}
+
+void writeGifBinary(ByteSink& sink, const int width, const int height, const std::vector<GifFrame>& frames,
+                    const GifOptions& options)
+{
+    LOG_DEBUG("generating ", width, "x", height, " gif animation binary with ", frames.size(), " frame descriptors");
+
+    validateFrameDescriptors(width, height, frames, options);
+
+    auto globalColorTable = std::unique_ptr<GlobalColorTable>{};
+    if (options.colorTableMode == ColorTableMode::Global)
+    {
+        const auto images = frames | map([](const auto& frame) { return frame.image; }) | toVector();
+        globalColorTable = std::make_unique<GlobalColorTable>(
+            getGlobalColorTable(images, options.globalColorTableFrameStride, false, options));
+    }
+
+    auto buffer = SinkBuffer{sink};
+
+    writeAnimationStart(buffer.bytes(), width, height, globalColorTable.get(), options.loopCount);
+
+    writeFramesInBatches(sink, buffer, static_cast<int>(frames.size()), options.threadsCount,
+                         [&](const int index, std::vector<uint8_t>& bytes, SinkBuffer* const sinkBuffer)
+                         {
+                             const auto& frame = frames[index];
+                             const auto& image = *frame.image;
+                             const auto previous = nullptr;
+                             const auto x0 = 0;
+                             const auto y0 = 0;
+                             writeFrameRegion(bytes, image, previous, globalColorTable.get(), x0, y0, image.width(),
+                                              image.height(), frame.x, frame.y, frame.delayCentiseconds,
+                                              frame.disposalMethod, options, 1, sinkBuffer);
+                         });
+
+    buffer.bytes().push_back(trailer);
+    buffer.flush();
+}
+
+std::vector<uint8_t> getGifBinary(const Image& image)
+{
+    return getGifBinary(image, GifOptions{});
+}
+
+std::vector<uint8_t> getGifBinary(const Image& image, const GifOptions& options)
+{
+    auto sink = MemorySink{};
+    writeGifBinary(sink, image, options);
+    return sink.release();
+}
+
+std::vector<uint8_t> getGifBinary(const IndexedImage& image)
+{
+    return getGifBinary(image, GifOptions{});
+}
+
+std::vector<uint8_t> getGifBinary(const IndexedImage& image, const GifOptions& options)
+{
+    auto sink = MemorySink{};
+    writeGifBinary(sink, image, options);
+    return sink.release();
+}
+
+std::vector<uint8_t> getGifBinary(const std::vector<const Image*>& frames, const int periodCentiseconds)
+{
+    return getGifBinary(frames, periodCentiseconds, GifOptions{});
+}
+
+std::vector<uint8_t> getGifBinary(const std::vector<const Image*>& frames, const int periodCentiseconds,
+                                  const GifOptions& options)
+{
+    auto sink = MemorySink{};
+    writeGifBinary(sink, frames, periodCentiseconds, options);
+    return sink.release();
+}
+
+std::vector<uint8_t> getGifBinary(const std::vector<const Image*>& frames, const std::vector<int>& delaysCentiseconds)
+{
+    return getGifBinary(frames, delaysCentiseconds, GifOptions{});
+}
+
+std::vector<uint8_t> getGifBinary(const std::vector<const Image*>& frames, const std::vector<int>& delaysCentiseconds,
+                                  const GifOptions& options)
+{
+    auto sink = MemorySink{};
+    writeGifBinary(sink, frames, delaysCentiseconds, options);
+    return sink.release();
+}
+
+std::vector<uint8_t> getGifBinary(const int width, const int height, const std::vector<GifFrame>& frames)
+{
+    return getGifBinary(width, height, frames, GifOptions{});
+}
+
+std::vector<uint8_t> getGifBinary(const int width, const int height, const std::vector<GifFrame>& frames,
+                                  const GifOptions& options)
+{
+    auto sink = MemorySink{};
+    writeGifBinary(sink, width, height, frames, options);
+    return sink.release();
+}
+
+void writeGifFile(const std::string& path, const Image& image)
+{
+    writeGifFile(path, image, GifOptions{});
+}
+
+void writeGifFile(const std::string& path, const Image& image, const GifOptions& options)
+{
+    validateImage(image, options);
+
+    auto sink = FileSink{path};
+    writeGifBinary(sink, image, options);
+    sink.commit();
+}
+
+void writeGifFile(const std::string& path, const IndexedImage& image)
+{
+    writeGifFile(path, image, GifOptions{});
+}
+
+void writeGifFile(const std::string& path, const IndexedImage& image, const GifOptions& options)
+{
+    validateIndexedImage(image);
+
+    auto sink = FileSink{path};
+    writeGifBinary(sink, image, options);
+    sink.commit();
+}
+
+void writeGifFile(const std::string& path, const std::vector<const Image*>& frames, const int periodCentiseconds)
+{
+    writeGifFile(path, frames, periodCentiseconds, GifOptions{});
+}
+
+void writeGifFile(const std::string& path, const std::vector<const Image*>& frames, const int periodCentiseconds,
+                  const GifOptions& options)
+{
+    writeGifFile(path, frames, std::vector<int>(frames.size(), periodCentiseconds), options);
+}
+
+void writeGifFile(const std::string& path, const std::vector<const Image*>& frames,
+                  const std::vector<int>& delaysCentiseconds)
+{
+    writeGifFile(path, frames, delaysCentiseconds, GifOptions{});
+}
+
+void writeGifFile(const std::string& path, const std::vector<const Image*>& frames,
+                  const std::vector<int>& delaysCentiseconds, const GifOptions& options)
+{
+    validateAnimation(frames, delaysCentiseconds, options);
+
+    auto sink = FileSink{path};
+    writeGifBinary(sink, frames, delaysCentiseconds, options);
+    sink.commit();
+}
+
+void writeGifFile(const std::string& path, const int width, const int height, const std::vector<GifFrame>& frames)
+{
+    writeGifFile(path, width, height, frames, GifOptions{});
+}
+
+void writeGifFile(const std::string& path, const int width, const int height, const std::vector<GifFrame>& frames,
+                  const GifOptions& options)
+{
+    validateFrameDescriptors(width, height, frames, options);
+
+    auto sink = FileSink{path};
+    writeGifBinary(sink, width, height, frames, options);
+    sink.commit();
+}
+
+GifWriter::GifWriter(const std::string& path, const int width, const int height)
+    : GifWriter{path, width, height, GifOptions{}}
+{
+}
+
+GifWriter::GifWriter(const std::string& path, const int width, const int height, const GifOptions& options)
+    : GifWriter{std::make_unique<FileSink>(path), nullptr, width, height, options}
+{
+    LOG_DEBUG("opened gif writer for ", width, "x", height, " animation at ", path);
+}
+
+GifWriter::GifWriter(ByteSink& sink, const int width, const int height) : GifWriter{sink, width, height, GifOptions{}}
+{
+}
+
+GifWriter::GifWriter(ByteSink& sink, const int width, const int height, const GifOptions& options)
+    : GifWriter{nullptr, &sink, width, height, options}
+{
+}
+
+GifWriter::GifWriter(std::unique_ptr<FileSink> ownedSink, ByteSink* const sink, const int width, const int height,
+                     const GifOptions& options)
+    : ownedSink_{std::move(ownedSink)},
+      sink_{ownedSink_ ? ownedSink_.get() : sink},
+      width_{width},
+      height_{height},
+      options_{options},
+      started_{false},
+      pendingDelayCentiseconds_{0},
+      pendingFrameHash_{0}
+{
+    if (width <= 0 || height <= 0)
+    {
+        THROW(std::invalid_argument, "gif writer dimensions ", width, "x", height, " must be greater than zero");
+    }
+
+    // The global color table is built from the first frame, so the logical screen waits for it.
+    if (options_.colorTableMode != ColorTableMode::Global)
+    {
+        writeAnimationStart(buffer_, width_, height_, nullptr, options_.loopCount);
+        flush();
+        started_ = true;
+    }
+}
+
+GifWriter::~GifWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& exception)
+    {
+        LOG_DEBUG("failed to close gif writer: ", exception.what());
+    }
+}
+
+void GifWriter::addFrame(const Image& frame, const int delayCentiseconds)
+{
+    if (!sink_)
+    {
+        THROW(std::logic_error, "cannot add frames to a closed gif writer");
+    }
+
+    validateAnimationFrame(frame, width_, height_);
+    validateDelay(delayCentiseconds);
+
+    if (!started_)
+    {
+        globalColorTable_ = std::make_unique<GlobalColorTable>(
+            getGlobalColorTable({&frame}, 1, options_.deltaFrames, options_));
+        writeAnimationStart(buffer_, width_, height_, globalColorTable_.get(), options_.loopCount);
+        started_ = true;
+    }
+
+    const auto holdsFrames = options_.mergeIdenticalFrames || (options_.deltaFrames && options_.alphaThreshold > 0);
+    if (!holdsFrames)
+    {
+        writeFrame(frame, delayCentiseconds, nullptr);
+        return;
+    }
+
+    const auto frameHash = options_.mergeIdenticalFrames ? getFrameHash(frame) : 0;
+    if (options_.mergeIdenticalFrames && !pendingFrame_.empty() &&
+        isSameFrame(frame, frameHash, pendingFrame_, pendingFrameHash_) &&
+        pendingDelayCentiseconds_ + delayCentiseconds <= maximumDelayCentiseconds)
+    {
+        pendingDelayCentiseconds_ += delayCentiseconds;
+        return;
+    }
+
+    if (!pendingFrame_.empty())
+    {
+        writeFrame(pendingFrame_, pendingDelayCentiseconds_, &frame);
+    }
+
+    pendingFrame_ = frame;
+    pendingDelayCentiseconds_ = delayCentiseconds;
+    pendingFrameHash_ = frameHash;
+}
+
+void GifWriter::writeFrame(const Image& frame, const int delayCentiseconds, const Image* next)
+{
+    flush();
+
+    auto sinkBuffer = SinkBuffer{*sink_};
+    const auto previous = previousFrame_.empty() ? nullptr : &previousFrame_;
+    writeAnimationFrame(sinkBuffer.bytes(), frame, previous, next, globalColorTable_.get(), width_, height_,
+                        delayCentiseconds, options_, options_.threadsCount, &sinkBuffer);
+    sinkBuffer.flush();
+
+    if (options_.deltaFrames)
+    {
+        previousFrame_ = isClearingScreen(frame, next, options_) ? Image{} : frame;
+    }
+}
+
+void GifWriter::close()
+{
+    if (sink_)
+    {
+        if (!started_)
+        {
+            writeAnimationStart(buffer_, width_, height_, nullptr, options_.loopCount);
+            started_ = true;
+        }
+
+        if (!pendingFrame_.empty())
         {
-            THROW(std::invalid_argument, "gif animation frames do not match in size");
+            const auto frame = std::move(pendingFrame_);
+            pendingFrame_ = Image{};
+            writeFrame(frame, pendingDelayCentiseconds_, nullptr);
         }
 
-        writeGraphicControlExtension(bytes, periodCentiseconds, DisposalMethod::NotSpecified);
+        buffer_.push_back(trailer);
+        flush();
 
-        const auto x0 = 0;
-        const auto y0 = 0;
-        const auto [colors, indexes] = getImageColors(*frame, x0, y0, frame->width(), frame->height());
-        const auto localColorsCount = static_cast<int>(colors.size());
+        if (ownedSink_)
+        {
+            ownedSink_->commit();
+        }
 
-        writeImageDescriptor(bytes, x0, y0, width, height, localColorsCount);
-        writeColorTable(bytes, colors);
-        writeImageData(bytes, indexes, localColorsCount);
+        sink_ = nullptr;
+        ownedSink_.reset();
     }
+}
 
-    bytes.push_back(trailer);
+void GifWriter::flush()
+{
+    sink_->write(buffer_);
+    buffer_.clear();
+}
+
+class GifReader
+{
+public:
+    explicit GifReader(const std::vector<uint8_t>& binary) : binary_{binary}, position_{0}
+    {
+    }
 
-    return bytes;
+    int readByte()
+    {
+        require(1);
+        return binary_[position_++];
+    }
+
+    int readWord()
+    {
+        require(2);
+        const auto value = binary_[position_] | (binary_[position_ + 1] << 8);
+        position_ += 2;
+        return value;
+    }
+
+    const uint8_t* readBytes(const int count)
+    {
+        require(count);
+        const auto bytes = binary_.data() + position_;
+        position_ += count;
+        return bytes;
+    }
+
+    void readSubBlocks(std::vector<uint8_t>& data)
+    {
+        for (auto size = readByte(); size != blockTerminator; size = readByte())
+        {
+            const auto bytes = readBytes(size);
+            data.insert(data.end(), bytes, bytes + size);
+        }
+    }
+
+    void skipSubBlocks()
+    {
+        for (auto size = readByte(); size != blockTerminator; size = readByte())
+        {
+            readBytes(size);
+        }
+    }
+
+private:
+    void require(const int count) const
+    {
+        if (position_ + count > static_cast<int>(binary_.size()))
+        {
+            THROW(GifReadException, "gif is truncated -- expected ", count, " more bytes at offset ", position_,
+                  " but the binary has only ", binary_.size(), " bytes");
+        }
+    }
+
+    const std::vector<uint8_t>& binary_;
+    int position_;
+};
+
+static std::vector<Color> readColorTable(GifReader& reader, const int sizeField)
+{
+    const auto colorsCount = 1 << (sizeField + 1);
+    const auto bytes = reader.readBytes(3 * colorsCount);
+
+    auto colors = std::vector<Color>(colorsCount);
+    for (auto index = 0; index < colorsCount; ++index)
+    {
+        colors[index] = Color{bytes[3 * index], bytes[3 * index + 1], bytes[3 * index + 2]};
+    }
+    return colors;
+}
+
+// The indexes must have room for one maximum length sequence past the output size, so that the last sequence can be
+// written without bounds checks. Pixels past the output size are ignored.
+static void decodeLzw(const std::vector<uint8_t>& data, const int minimumCodeSize, const int outputSize,
+                      std::vector<uint8_t>& indexes)
+{
+    constexpr auto maximumCodeSize = LzwDictionary::maximumCodeSize;
+    constexpr auto maximumCodesCount = LzwDictionary::maximumCodesCount;
+
+    if (minimumCodeSize < 1 || minimumCodeSize >= maximumCodeSize)
+    {
+        THROW(GifReadException, "gif LZW minimum code size ", minimumCodeSize, " is out of range");
+    }
+
+    const auto clearCode = 1 << minimumCodeSize;
+    const auto endCode = clearCode + 1;
+
+    // Every code is stored as its prefix code plus its last symbol, so the sequence of a code is recovered by walking
+    // the prefix chain backwards while the length tells where the sequence ends in the output.
+    uint16_t prefixes[maximumCodesCount];
+    uint8_t suffixes[maximumCodesCount];
+    uint16_t lengths[maximumCodesCount];
+
+    for (auto code = 0; code < clearCode; ++code)
+    {
+        prefixes[code] = 0;
+        suffixes[code] = static_cast<uint8_t>(code);
+        lengths[code] = 1;
+    }
+
+    const auto dataSize = static_cast<int>(data.size());
+
+    auto codeSize = minimumCodeSize + 1;
+    auto nextCode = clearCode + 2;
+    auto previousCode = -1;
+
+    auto accumulator = uint32_t{0};
+    auto accumulatorBits = 0;
+    auto dataPosition = 0;
+    auto outputPosition = 0;
+
+    while (outputPosition < outputSize)
+    {
+        while (accumulatorBits < codeSize && dataPosition < dataSize)
+        {
+            accumulator |= static_cast<uint32_t>(data[dataPosition++]) << accumulatorBits;
+            accumulatorBits += 8;
+        }
+
+        if (accumulatorBits < codeSize)
+        {
+            break;
+        }
+
+        const auto code = static_cast<int>(accumulator & ((1U << codeSize) - 1U));
+        accumulator >>= codeSize;
+        accumulatorBits -= codeSize;
+
+        if (code == clearCode)
+        {
+            codeSize = minimumCodeSize + 1;
+            nextCode = clearCode + 2;
+            previousCode = -1;
+            continue;
+        }
+
+        if (code == endCode)
+        {
+            break;
+        }
+
+        if (code > nextCode || (code == nextCode && previousCode == -1))
+        {
+            THROW(GifReadException, "gif LZW code ", code, " is invalid -- the next available code is ", nextCode);
+        }
+
+        // A code that is not in the dictionary yet can only be the previous sequence followed by its own first
+        // symbol.
+        const auto isNextCode = code == nextCode;
+        const auto sequenceCode = isNextCode ? previousCode : code;
+        const auto sequenceLength = lengths[sequenceCode] + isNextCode;
+
+        auto current = sequenceCode;
+        for (auto position = outputPosition + lengths[sequenceCode] - 1; position > outputPosition; --position)
+        {
+            indexes[position] = suffixes[current];
+            current = prefixes[current];
+        }
+
+        const auto firstSymbol = suffixes[current];
+        indexes[outputPosition] = firstSymbol;
+        if (isNextCode)
+        {
+            indexes[outputPosition + sequenceLength - 1] = firstSymbol;
+        }
+
+        if (previousCode != -1 && nextCode < maximumCodesCount)
+        {
+            prefixes[nextCode] = static_cast<uint16_t>(previousCode);
+            suffixes[nextCode] = firstSymbol;
+            lengths[nextCode] = lengths[previousCode] + 1;
+            ++nextCode;
+
+            if (nextCode == (1 << codeSize) && codeSize < maximumCodeSize)
+            {
+                ++codeSize;
+            }
+        }
+
+        previousCode = code;
+        outputPosition += sequenceLength;
+    }
 }
 
-void writeGifFile(const std::string& path, const dansandu::canvas::image::Image& image)
+std::vector<Image> decodeGif(const std::vector<uint8_t>& binary)
 {
-    const auto binary = getGifBinary(image);
-    writeBinaryFile(path, binary);
+    LOG_DEBUG("decoding gif binary of ", binary.size(), " bytes");
+
+    auto reader = GifReader{binary};
+
+    const auto signature = reader.readBytes(6);
+    if (!std::equal(signature, signature + 3, "GIF") ||
+        !(std::equal(signature + 3, signature + 6, "87a") || std::equal(signature + 3, signature + 6, "89a")))
+    {
+        THROW(GifReadException, "gif signature does not match GIF87a or GIF89a");
+    }
+
+    const auto screenWidth = reader.readWord();
+    const auto screenHeight = reader.readWord();
+    const auto screenFields = reader.readByte();
+    const auto backgroundColorIndex = reader.readByte();
+    const auto pixelAspectRatio = reader.readByte();
+    static_cast<void>(backgroundColorIndex);
+    static_cast<void>(pixelAspectRatio);
+
+    auto globalColors = std::vector<Color>{};
+    if (screenFields & 0x80)
+    {
+        globalColors = readColorTable(reader, screenFields & 0x07);
+    }
+
+    // Restoring to the background color is done with transparent pixels, which is what browsers do as well.
+    const auto background = Color{0, 0, 0, 0};
+
+    auto frames = std::vector<Image>{};
+    auto canvas = Image{screenWidth, screenHeight, background};
+    auto previousCanvas = Image{};
+
+    auto disposalMethod = DisposalMethod::NotSpecified;
+    auto hasTransparentColor = false;
+    auto transparentColorIndex = 0;
+
+    auto data = std::vector<uint8_t>{};
+    auto indexes = std::vector<uint8_t>{};
+
+    for (auto introducer = reader.readByte(); introducer != trailer; introducer = reader.readByte())
+    {
+        if (introducer == extensionIntroducer)
+        {
+            const auto label = reader.readByte();
+            if (label == graphicControlLabel)
+            {
+                const auto blockSize = reader.readByte();
+                const auto block = reader.readBytes(blockSize);
+                if (blockSize < 4)
+                {
+                    THROW(GifReadException, "gif graphic control extension block size ", blockSize, " is too small");
+                }
+                disposalMethod = static_cast<DisposalMethod>((block[0] >> 2) & 0x07);
+                hasTransparentColor = block[0] & 0x01;
+                transparentColorIndex = block[3];
+            }
+            reader.skipSubBlocks();
+        }
+        else if (introducer == imageDescriptorLabel)
+        {
+            const auto x0 = reader.readWord();
+            const auto y0 = reader.readWord();
+            const auto width = reader.readWord();
+            const auto height = reader.readWord();
+            const auto imageFields = reader.readByte();
+
+            const auto localColors =
+                (imageFields & 0x80) ? readColorTable(reader, imageFields & 0x07) : std::vector<Color>{};
+            const auto& colors = localColors.empty() ? globalColors : localColors;
+            if (colors.empty())
+            {
+                THROW(GifReadException, "gif image has neither a local nor a global color table");
+            }
+
+            const auto isInterlaced = (imageFields & 0x40) != 0;
+
+            const auto minimumCodeSize = reader.readByte();
+            data.clear();
+            reader.readSubBlocks(data);
+
+            indexes.assign(width * height + LzwDictionary::maximumCodesCount, 0);
+            decodeLzw(data, minimumCodeSize, width * height, indexes);
+
+            if (disposalMethod == DisposalMethod::RestoreToPrevious)
+            {
+                previousCanvas = canvas;
+            }
+
+            // Interlaced rows are stored pass by pass, so each image row is looked up at its position in that order.
+            const auto rowPositions = isInterlaced ? getInterlacedRowPositions(height) : std::vector<int>{};
+
+            const auto colorsCount = static_cast<int>(colors.size());
+            const auto xStart = std::min(x0, screenWidth);
+            const auto widthBound = std::max(xStart, std::min(x0 + width, screenWidth));
+            const auto heightBound = std::min(y0 + height, screenHeight);
+            for (auto y = y0; y < heightBound; ++y)
+            {
+                const auto rowPosition = isInterlaced ? rowPositions[y - y0] : y - y0;
+                const auto row = indexes.cbegin() + rowPosition * width;
+                const auto canvasRow = canvas.begin() + y * screenWidth;
+                for (auto x = xStart; x < widthBound; ++x)
+                {
+                    const auto index = row[x - x0];
+                    if (!(hasTransparentColor && index == transparentColorIndex) && index < colorsCount)
+                    {
+                        canvasRow[x] = colors[index];
+                    }
+                }
+            }
+
+            frames.push_back(canvas);
+
+            if (disposalMethod == DisposalMethod::RestoreToBackgroundColor)
+            {
+                for (auto y = y0; y < heightBound; ++y)
+                {
+                    std::fill(canvas.begin() + y * screenWidth + xStart, canvas.begin() + y * screenWidth + widthBound,
+                              background);
+                }
+            }
+            else if (disposalMethod == DisposalMethod::RestoreToPrevious)
+            {
+                canvas = std::move(previousCanvas);
+            }
+
+            disposalMethod = DisposalMethod::NotSpecified;
+            hasTransparentColor = false;
+        }
+        else
+        {
+            THROW(GifReadException, "gif block introducer ", introducer, " is not recognized");
+        }
+    }
+
+    return frames;
 }
 
-void writeGifFile(const std::string& path, const std::vector<const dansandu::canvas::image::Image*>& frames,
-                  const int periodCentiseconds)
+std::vector<Image> readGifFile(const std::string& path)
 {
-    const auto binary = getGifBinary(frames, periodCentiseconds);
-    writeBinaryFile(path, binary);
+    return decodeGif(readBinaryFile(path));
 }
 
 }
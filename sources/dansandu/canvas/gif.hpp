@@ -1,24 +1,301 @@
 #pragma once
 
 #include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/indexed_image.hpp"
+#include "dansandu/canvas/sink.hpp"
 
+#include <exception>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace dansandu::canvas::gif
 {
 
-std::pair<std::vector<uint8_t>, int> lzw(const std::vector<int>& input, const int alphabetSize);
+class GifReadException : public std::exception
+{
+public:
+    explicit GifReadException(std::string message) : message_{std::move(message)}
+    {
+    }
+
+    const char* what() const noexcept override
+    {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+enum class ColorTableMode
+{
+    Local,
+    Global
+};
+
+enum class Quantizer
+{
+    Uniform,
+    MedianCut,
+    Octree
+};
+
+// What happens to the area of a frame once its delay is over, before the next frame is drawn.
+enum class DisposalMethod
+{
+    NotSpecified = 0,
+    DoNotDispose = 1,
+    RestoreToBackgroundColor = 2,
+    RestoreToPrevious = 3
+};
+
+enum class Dithering
+{
+    None,
+    FloydSteinberg,
+    Ordered
+};
+
+struct GifOptions
+{
+    // Once the LZW dictionary is full, periodically compare the compression ratio against the best one seen since the
+    // last reset and emit a clear code when it drops. Without it the full dictionary is kept until the end of the
+    // frame.
+    bool adaptiveClearCode = false;
+
+    // Number of threads encoding animation frames concurrently, or applying ordered dithering to the rows of a single
+    // image, where zero picks the hardware concurrency. The output does not depend on it.
+    int threadsCount = 1;
+
+    // Encode each animation frame as the region that changed since the previous frame, with unchanged pixels inside it
+    // left transparent so the previous frame shows through.
+    bool deltaFrames = false;
+
+    // Local gives every frame its own color table. Global writes a single color table shared by all frames, which saves
+    // up to 768 bytes per frame.
+    ColorTableMode colorTableMode = ColorTableMode::Local;
+
+    // Only every n-th frame contributes colors to the global color table, colors of the other frames are mapped to the
+    // nearest color in it. GifWriter builds the global color table from the first frame.
+    int globalColorTableFrameStride = 1;
+
+    // Picks the palette of images with more than 256 colors. Uniform snaps colors to a fixed 4x8x8 grid, which is the
+    // fastest but wastes entries on colors the image does not use. MedianCut and Octree adapt the palette to the
+    // color distribution of the image.
+    Quantizer quantizer = Quantizer::Uniform;
+
+    // Spreads the error of colors lost to palette reduction so gradients do not band. FloydSteinberg diffuses it to
+    // the neighbouring pixels and looks the smoothest. Ordered adds a fixed 8x8 Bayer pattern, which is faster, spreads
+    // single images over threadsCount threads and keeps the pattern stable between animation frames.
+    Dithering dithering = Dithering::None;
+
+    // Store the rows of every image in four passes, so browsers can show a coarse version of large images while the
+    // rest is still loading.
+    bool interlaced = false;
+
+    // Pixels with an alpha below the threshold are written as a transparent color kept in the palette. The default of
+    // zero leaves every pixel opaque.
+    int alphaThreshold = 0;
+
+    // Lets the LZW encoder extend a sequence with a pixel whose color is within this distance of the actual one,
+    // which trades a bounded error per pixel for longer sequences and smaller files. Zero keeps the encoding exact.
+    int lossiness = 0;
+
+    // Merge runs of identical consecutive animation frames into their first frame, shown for their combined delay.
+    // Decoding the animation then gives one frame per run.
+    bool mergeIdenticalFrames = false;
+
+    // Times an animation repeats after it is first shown, where zero repeats it forever and a negative count shows it
+    // only once.
+    int loopCount = 0;
+
+    // Splits single images taller than this into horizontal bands sharing the global color table, which are
+    // compressed concurrently and written as separate images. Browsers may show the bands one after another, as
+    // frames with no delay. Zero keeps every image whole.
+    int bandHeight = 0;
+};
+
+enum class Effort
+{
+    Fastest,
+    Balanced,
+    Smallest
+};
+
+// Returns options trading encoding speed for file size at the same quality, which can be adjusted further.
+PRALINE_EXPORT GifOptions getEffortOptions(const Effort effort);
+
+// An animation frame drawn at an offset of the logical screen, shown for its own delay and then disposed of as asked.
+struct GifFrame
+{
+    const dansandu::canvas::image::Image* image = nullptr;
+    int delayCentiseconds = 0;
+    DisposalMethod disposalMethod = DisposalMethod::NotSpecified;
+    int x = 0;
+    int y = 0;
+};
+
+// Returns the LZW codes of the palette indexes packed the way GIF image data expects them, along with the minimum code
+// size. It is instantiated for uint8_t, uint16_t and int indexes, where uint8_t is the one the encoder itself uses.
+template<typename Index>
+std::pair<std::vector<uint8_t>, int> lzw(const std::vector<Index>& input, const int alphabetSize,
+                                         const bool adaptiveClearCode = false);
 
 PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const dansandu::canvas::image::Image& image);
 
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const dansandu::canvas::image::Image& image,
+                                                 const GifOptions& options);
+
+// Encodes the palette and indexes as they are, without any color reduction.
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const dansandu::canvas::indexed_image::IndexedImage& image);
+
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const dansandu::canvas::indexed_image::IndexedImage& image,
+                                                 const GifOptions& options);
+
 PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const std::vector<const dansandu::canvas::image::Image*>& frames,
                                                  const int periodCentiseconds);
 
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                                 const int periodCentiseconds, const GifOptions& options);
+
+// Shows every frame for its own delay, which must fit in 16 bits.
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                                 const std::vector<int>& delaysCentiseconds);
+
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                                 const std::vector<int>& delaysCentiseconds,
+                                                 const GifOptions& options);
+
+// Writes the frames as they are on a screen of the given size, so delta frames and merging do not apply to them.
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const int width, const int height,
+                                                 const std::vector<GifFrame>& frames);
+
+PRALINE_EXPORT std::vector<uint8_t> getGifBinary(const int width, const int height,
+                                                 const std::vector<GifFrame>& frames, const GifOptions& options);
+
+// Streams the binary to the sink in bounded chunks instead of building it whole. Animation frames encoded in parallel
+// are held until their turn comes, one per thread.
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink, const dansandu::canvas::image::Image& image);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink, const dansandu::canvas::image::Image& image,
+                                   const GifOptions& options);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const dansandu::canvas::indexed_image::IndexedImage& image);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const dansandu::canvas::indexed_image::IndexedImage& image,
+                                   const GifOptions& options);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                   const int periodCentiseconds);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                   const int periodCentiseconds, const GifOptions& options);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                   const std::vector<int>& delaysCentiseconds);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink,
+                                   const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                   const std::vector<int>& delaysCentiseconds, const GifOptions& options);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink, const int width, const int height,
+                                   const std::vector<GifFrame>& frames);
+
+PRALINE_EXPORT void writeGifBinary(dansandu::canvas::sink::ByteSink& sink, const int width, const int height,
+                                   const std::vector<GifFrame>& frames, const GifOptions& options);
+
 PRALINE_EXPORT void writeGifFile(const std::string& path, const dansandu::canvas::image::Image& image);
 
+PRALINE_EXPORT void writeGifFile(const std::string& path, const dansandu::canvas::image::Image& image,
+                                 const GifOptions& options);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path, const dansandu::canvas::indexed_image::IndexedImage& image);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path, const dansandu::canvas::indexed_image::IndexedImage& image,
+                                 const GifOptions& options);
+
 PRALINE_EXPORT void writeGifFile(const std::string& path,
                                  const std::vector<const dansandu::canvas::image::Image*>& frames,
                                  const int periodCentiseconds);
 
+PRALINE_EXPORT void writeGifFile(const std::string& path,
+                                 const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                 const int periodCentiseconds, const GifOptions& options);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path,
+                                 const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                 const std::vector<int>& delaysCentiseconds);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path,
+                                 const std::vector<const dansandu::canvas::image::Image*>& frames,
+                                 const std::vector<int>& delaysCentiseconds, const GifOptions& options);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path, const int width, const int height,
+                                 const std::vector<GifFrame>& frames);
+
+PRALINE_EXPORT void writeGifFile(const std::string& path, const int width, const int height,
+                                 const std::vector<GifFrame>& frames, const GifOptions& options);
+
+struct GlobalColorTable;
+
+// Streams an animation to a file one frame at a time, so memory usage is bound by a single frame regardless of the
+// length of the animation. The trailer is written on close or, failing that, on destruction. A file only replaces the
+// one at the path once the writer is closed.
+class PRALINE_EXPORT GifWriter
+{
+public:
+    GifWriter(const std::string& path, const int width, const int height);
+
+    GifWriter(const std::string& path, const int width, const int height, const GifOptions& options);
+
+    // The sink must outlive the writer.
+    GifWriter(dansandu::canvas::sink::ByteSink& sink, const int width, const int height);
+
+    GifWriter(dansandu::canvas::sink::ByteSink& sink, const int width, const int height, const GifOptions& options);
+
+    GifWriter(const GifWriter&) = delete;
+
+    GifWriter& operator=(const GifWriter&) = delete;
+
+    ~GifWriter();
+
+    // Merging identical frames and delta frames with transparency both depend on the frame that comes next, so with
+    // either of them a frame is only written once the next one is added or the writer is closed.
+    void addFrame(const dansandu::canvas::image::Image& frame, const int delayCentiseconds);
+
+    void close();
+
+private:
+    GifWriter(std::unique_ptr<dansandu::canvas::sink::FileSink> ownedSink, dansandu::canvas::sink::ByteSink* const sink,
+              const int width, const int height, const GifOptions& options);
+
+    void flush();
+
+    void writeFrame(const dansandu::canvas::image::Image& frame, const int delayCentiseconds,
+                    const dansandu::canvas::image::Image* next);
+
+    std::unique_ptr<dansandu::canvas::sink::FileSink> ownedSink_;
+    dansandu::canvas::sink::ByteSink* sink_;
+    int width_;
+    int height_;
+    GifOptions options_;
+    bool started_;
+    std::vector<uint8_t> buffer_;
+    dansandu::canvas::image::Image previousFrame_;
+    dansandu::canvas::image::Image pendingFrame_;
+    int pendingDelayCentiseconds_;
+    uint64_t pendingFrameHash_;
+    std::unique_ptr<GlobalColorTable> globalColorTable_;
+};
+
+PRALINE_EXPORT std::vector<dansandu::canvas::image::Image> decodeGif(const std::vector<uint8_t>& binary);
+
+PRALINE_EXPORT std::vector<dansandu::canvas::image::Image> readGifFile(const std::string& path);
+
 }
@@ -4,8 +4,14 @@
 #include "dansandu/canvas/bitmap.hpp"
 #include "dansandu/canvas/color.hpp"
 #include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/quantization.hpp"
+#include "dansandu/canvas/sink.hpp"
 #include "dansandu/range/range.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -14,15 +20,131 @@ using dansandu::ballotin::file_system::writeBinaryFile;
 using dansandu::canvas::bitmap::readBitmapFile;
 using dansandu::canvas::color::Color;
 using dansandu::canvas::color::Colors;
+using dansandu::canvas::gif::ColorTableMode;
+using dansandu::canvas::gif::decodeGif;
+using dansandu::canvas::gif::DisposalMethod;
+using dansandu::canvas::gif::Dithering;
+using dansandu::canvas::gif::Effort;
+using dansandu::canvas::gif::getEffortOptions;
 using dansandu::canvas::gif::getGifBinary;
+using dansandu::canvas::gif::GifFrame;
+using dansandu::canvas::gif::GifOptions;
+using dansandu::canvas::gif::GifReadException;
+using dansandu::canvas::gif::GifWriter;
 using dansandu::canvas::gif::lzw;
+using dansandu::canvas::gif::Quantizer;
+using dansandu::canvas::gif::readGifFile;
+using dansandu::canvas::gif::writeGifBinary;
 using dansandu::canvas::gif::writeGifFile;
 using dansandu::canvas::image::Image;
+using dansandu::canvas::indexed_image::IndexedImage;
+using dansandu::canvas::quantization::ColorHistogram;
+using dansandu::canvas::quantization::getIndexedImage;
+using dansandu::canvas::quantization::getMedianCutPalette;
+using dansandu::canvas::sink::CallbackSink;
+using dansandu::canvas::sink::MemorySink;
+using dansandu::canvas::sink::SinkBuffer;
 
 using bytes_type = std::vector<uint8_t>;
 
 using namespace dansandu::range::range;
 
+static Image makeNoisyImage(const int width, const int height)
+{
+    auto image = Image{width, height};
+    auto seed = 7U;
+    for (auto y = 0; y < height; ++y)
+    {
+        for (auto x = 0; x < width; ++x)
+        {
+            seed = seed * 1103515245U + 12345U;
+            image(x, y) = Color{static_cast<Color::value_type>((seed >> 16) & 0xC0),
+                                static_cast<Color::value_type>((seed >> 20) & 0xC0),
+                                static_cast<Color::value_type>((seed >> 24) & 0x80)};
+        }
+    }
+    return image;
+}
+
+static std::vector<Image> makeDashboardFrames(const int framesCount)
+{
+    auto frames = std::vector<Image>{makeNoisyImage(200, 150)};
+    for (auto index = 1; index < framesCount; ++index)
+    {
+        auto frame = frames.back();
+        for (auto y = 40; y < 50; ++y)
+        {
+            for (auto x = 20 + 7 * index; x < 30 + 7 * index; ++x)
+            {
+                frame(x, y) = index % 2 ? Colors::amber : Colors::azure;
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+static Image makeGradientImage(const int width, const int height)
+{
+    auto image = Image{width, height};
+    for (auto y = 0; y < height; ++y)
+    {
+        for (auto x = 0; x < width; ++x)
+        {
+            image(x, y) = Color{static_cast<Color::value_type>(x * 255 / width),
+                                static_cast<Color::value_type>(y * 255 / height),
+                                static_cast<Color::value_type>((x + y) * 255 / (width + height))};
+        }
+    }
+    return image;
+}
+
+static double getMeanSquaredError(const Image& expected, const Image& actual)
+{
+    auto error = 0.0;
+    for (auto position = 0; position < static_cast<int>(expected.size()); ++position)
+    {
+        const auto red = expected.cbegin()[position].red() - actual.cbegin()[position].red();
+        const auto green = expected.cbegin()[position].green() - actual.cbegin()[position].green();
+        const auto blue = expected.cbegin()[position].blue() - actual.cbegin()[position].blue();
+        error += red * red + green * green + blue * blue;
+    }
+    return error / expected.size();
+}
+
+// Banding shows up as error that does not average out over neighbouring pixels, so compare 4x4 block averages.
+static double getBlockMeanSquaredError(const Image& expected, const Image& actual)
+{
+    constexpr auto blockSize = 4;
+
+    auto error = 0.0;
+    auto blocksCount = 0;
+    for (auto y = 0; y + blockSize <= expected.height(); y += blockSize)
+    {
+        for (auto x = 0; x + blockSize <= expected.width(); x += blockSize)
+        {
+            int sums[3] = {};
+            for (auto dy = 0; dy < blockSize; ++dy)
+            {
+                for (auto dx = 0; dx < blockSize; ++dx)
+                {
+                    sums[0] += expected(x + dx, y + dy).red() - actual(x + dx, y + dy).red();
+                    sums[1] += expected(x + dx, y + dy).green() - actual(x + dx, y + dy).green();
+                    sums[2] += expected(x + dx, y + dy).blue() - actual(x + dx, y + dy).blue();
+                }
+            }
+
+            for (const auto sum : sums)
+            {
+                const auto average = static_cast<double>(sum) / (blockSize * blockSize);
+                error += average * average;
+            }
+            ++blocksCount;
+        }
+    }
+    return error / blocksCount;
+}
+
 TEST_CASE("gif")
 {
     SECTION("lzw")
@@ -94,6 +216,64 @@ TEST_CASE("gif")
 
             REQUIRE(minimumCodeSize == expectedMinimumCodeSize);
         }
+
+        SECTION("byte symbols")
+        {
+            const auto input = makeNoisyImage(64, 64) | map([](const auto color) { return color.red() >> 2; }) |
+                               toVector();
+            const auto bytes = input | map([](const auto symbol) { return static_cast<uint8_t>(symbol); }) | toVector();
+            const auto alphabetSize = 64;
+            const auto adaptiveClearCode = false;
+
+            REQUIRE(lzw(bytes, alphabetSize, adaptiveClearCode) == lzw(input, alphabetSize));
+        }
+
+        SECTION("wide symbols")
+        {
+            const auto input = makeNoisyImage(64, 64) | map([](const auto color) { return color.red(); }) | toVector();
+            const auto words = input | map([](const auto symbol) { return static_cast<uint16_t>(symbol); }) |
+                               toVector();
+            const auto integers =
+                input | map([](const auto symbol) { return static_cast<int>(symbol); }) | toVector();
+            const auto alphabetSize = 256;
+
+            REQUIRE(lzw(words, alphabetSize) == lzw(input, alphabetSize));
+            REQUIRE(lzw(integers, alphabetSize) == lzw(input, alphabetSize));
+        }
+
+        SECTION("symbols outside the alphabet")
+        {
+            REQUIRE_THROWS_AS(lzw(std::vector<int>{{0, 1, 4}}, 4), std::invalid_argument);
+            REQUIRE_THROWS_AS(lzw(std::vector<int>{{0, -1}}, 4), std::invalid_argument);
+            REQUIRE_THROWS_AS(lzw(std::vector<uint8_t>{{0, 200}}, 128), std::invalid_argument);
+        }
+    }
+
+    SECTION("adaptive clear code")
+    {
+        auto options = GifOptions{};
+        options.adaptiveClearCode = true;
+
+        SECTION("noisy image")
+        {
+            const auto image = makeNoisyImage(512, 512);
+
+            REQUIRE(getGifBinary(image, options).size() <= getGifBinary(image).size());
+        }
+
+        SECTION("gradient image")
+        {
+            const auto image = makeGradientImage(512, 512);
+
+            REQUIRE(getGifBinary(image, options).size() < getGifBinary(image).size() / 2);
+        }
+
+        SECTION("decodes like the default encoding")
+        {
+            const auto image = makeGradientImage(512, 512);
+
+            REQUIRE(decodeGif(getGifBinary(image, options)) == decodeGif(getGifBinary(image)));
+        }
     }
 
     const auto toInt = [](auto value) { return static_cast<int>(value); };
@@ -192,6 +372,27 @@ TEST_CASE("gif")
         }
     }
 
+    SECTION("quantizers")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        const auto uniformError = getMeanSquaredError(image, decodeGif(getGifBinary(image)).front());
+
+        for (const auto quantizer : {Quantizer::MedianCut, Quantizer::Octree})
+        {
+            auto options = GifOptions{};
+            options.quantizer = quantizer;
+
+            const auto local = decodeGif(getGifBinary(image, options));
+            REQUIRE(local.size() == 1);
+            REQUIRE(getMeanSquaredError(image, local.front()) < uniformError);
+
+            options.colorTableMode = ColorTableMode::Global;
+            const auto global = decodeGif(getGifBinary(image, options));
+            REQUIRE(global.size() == 1);
+            REQUIRE(getMeanSquaredError(image, global.front()) < uniformError);
+        }
+    }
+
     SECTION("large animation")
     {
         const auto expected = readBinaryFile("resources/dansandu/canvas/expected_animation.gif");
@@ -220,5 +421,1336 @@ TEST_CASE("gif")
         {
             SUCCEED("animation binary match");
         }
+
+        SECTION("parallel encoding")
+        {
+            auto options = GifOptions{};
+            options.threadsCount = 4;
+
+            REQUIRE(getGifBinary(frames, delayCentiseconds, options) == expected);
+        }
+    }
+}
+
+TEST_CASE("gif delta frames")
+{
+    auto options = GifOptions{};
+    options.deltaFrames = true;
+
+    const auto delayCentiseconds = 10;
+
+    SECTION("dashboard")
+    {
+        const auto images = makeDashboardFrames(8);
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        const auto binary = getGifBinary(frames, delayCentiseconds, options);
+
+        REQUIRE(decodeGif(binary) == images);
+
+        REQUIRE(binary.size() < getGifBinary(frames, delayCentiseconds).size() / 4);
+    }
+
+    SECTION("identical frames")
+    {
+        const auto images = std::vector<Image>(3, makeNoisyImage(20, 10));
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == images);
+    }
+
+    SECTION("reduced palette")
+    {
+        auto images = std::vector<Image>{{makeGradientImage(64, 64), makeGradientImage(64, 64)}};
+        for (auto y = 0; y < 32; ++y)
+        {
+            for (auto x = 0; x < 64; ++x)
+            {
+                images[1](x, y) =
+                    Color{static_cast<Color::value_type>(4 * x), static_cast<Color::value_type>(255 - 8 * y),
+                          static_cast<Color::value_type>(4 * x + y)};
+            }
+        }
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        const auto actual = decodeGif(getGifBinary(frames, delayCentiseconds, options));
+        const auto expected = decodeGif(getGifBinary(frames, delayCentiseconds));
+
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("reduced palette with unchanged pixels after the overflow")
+    {
+        auto images = std::vector<Image>{{makeGradientImage(64, 64), makeGradientImage(64, 64)}};
+        for (const auto y : {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 63})
+        {
+            for (auto x = 0; x < 64; ++x)
+            {
+                images[1](x, y) =
+                    Color{static_cast<Color::value_type>(4 * x), static_cast<Color::value_type>(255 - 8 * (y % 32)),
+                          static_cast<Color::value_type>(4 * x + y)};
+            }
+        }
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        const auto actual = decodeGif(getGifBinary(frames, delayCentiseconds, options));
+        const auto expected = decodeGif(getGifBinary(frames, delayCentiseconds));
+
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("writer")
+    {
+        const auto images = makeDashboardFrames(4);
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+        const auto path = std::string{"target/actual_writer_delta_animation.gif"};
+
+        auto writer = GifWriter{path, images.front().width(), images.front().height(), options};
+        for (const auto& image : images)
+        {
+            writer.addFrame(image, delayCentiseconds);
+        }
+        writer.close();
+
+        REQUIRE(readBinaryFile(path) == getGifBinary(frames, delayCentiseconds, options));
+    }
+}
+
+TEST_CASE("gif dithering")
+{
+    const auto image = makeGradientImage(256, 128);
+    const auto undithered = decodeGif(getGifBinary(image)).front();
+    const auto banding = getBlockMeanSquaredError(image, undithered);
+
+    SECTION("floyd steinberg")
+    {
+        auto options = GifOptions{};
+        options.dithering = Dithering::FloydSteinberg;
+
+        REQUIRE(getBlockMeanSquaredError(image, decodeGif(getGifBinary(image, options)).front()) < banding);
+    }
+
+    SECTION("ordered")
+    {
+        auto options = GifOptions{};
+        options.dithering = Dithering::Ordered;
+
+        const auto binary = getGifBinary(image, options);
+        REQUIRE(getBlockMeanSquaredError(image, decodeGif(binary).front()) < banding);
+
+        options.threadsCount = 4;
+        REQUIRE(getGifBinary(image, options) == binary);
+    }
+
+    SECTION("adaptive palettes")
+    {
+        for (const auto dithering : {Dithering::FloydSteinberg, Dithering::Ordered})
+        {
+            auto options = GifOptions{};
+            options.quantizer = Quantizer::MedianCut;
+
+            const auto adaptiveBanding =
+                getBlockMeanSquaredError(image, decodeGif(getGifBinary(image, options)).front());
+
+            options.dithering = dithering;
+            REQUIRE(getBlockMeanSquaredError(image, decodeGif(getGifBinary(image, options)).front()) <
+                    adaptiveBanding);
+        }
+    }
+
+    SECTION("global color table")
+    {
+        auto options = GifOptions{};
+        options.colorTableMode = ColorTableMode::Global;
+        options.dithering = Dithering::FloydSteinberg;
+
+        REQUIRE(getBlockMeanSquaredError(image, decodeGif(getGifBinary(image, options)).front()) < banding);
+    }
+
+    SECTION("few colors are not dithered")
+    {
+        const auto noisy = makeNoisyImage(64, 64);
+
+        auto options = GifOptions{};
+        options.dithering = Dithering::FloydSteinberg;
+
+        REQUIRE(getGifBinary(noisy, options) == getGifBinary(noisy));
+    }
+
+    SECTION("delta frames")
+    {
+        auto second = image;
+        for (auto x = 0; x < 32; ++x)
+        {
+            second(x, 64) = Colors::amber;
+        }
+
+        auto options = GifOptions{};
+        options.deltaFrames = true;
+        options.dithering = Dithering::Ordered;
+
+        const auto decoded = decodeGif(getGifBinary({&image, &second}, 10, options));
+        REQUIRE(decoded.size() == 2);
+        REQUIRE(decoded[1](0, 63) == decoded[0](0, 63));
+        REQUIRE(decoded[1](0, 64) == Color{Colors::amber});
+    }
+}
+
+// Moves the palette entry order[index] to index and renumbers the pixels to match, which leaves the image unchanged.
+static IndexedImage getReorderedImage(const IndexedImage& image, const std::vector<int>& order)
+{
+    auto palette = std::vector<Color>{};
+    auto renumbered = std::vector<uint8_t>(order.size());
+    for (auto index = 0; index < static_cast<int>(order.size()); ++index)
+    {
+        palette.push_back(image.palette()[order[index]]);
+        renumbered[order[index]] = static_cast<uint8_t>(index);
+    }
+
+    auto indexes = image.indexes();
+    for (auto& index : indexes)
+    {
+        index = renumbered[index];
+    }
+    return IndexedImage{image.width(), image.height(), std::move(palette), std::move(indexes)};
+}
+
+static std::vector<int> getLuminanceOrder(const std::vector<Color>& palette)
+{
+    auto order = std::vector<int>(palette.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&palette](const auto lhs, const auto rhs)
+                     {
+                         const auto luminance = [](const Color color)
+                         { return 299 * color.red() + 587 * color.green() + 114 * color.blue(); };
+                         return luminance(palette[lhs]) < luminance(palette[rhs]);
+                     });
+    return order;
+}
+
+TEST_CASE("gif indexed image")
+{
+    SECTION("matches the image encoding")
+    {
+        const auto image = makeNoisyImage(48, 32);
+
+        auto palette = std::vector<Color>{};
+        auto indexes = std::vector<uint8_t>{};
+        for (const auto color : image)
+        {
+            const auto position = std::find(palette.cbegin(), palette.cend(), color);
+            indexes.push_back(static_cast<uint8_t>(position - palette.cbegin()));
+            if (position == palette.cend())
+            {
+                palette.push_back(color);
+            }
+        }
+        const auto indexed = IndexedImage{image.width(), image.height(), palette, indexes};
+
+        REQUIRE(getGifBinary(indexed) == getGifBinary(image));
+
+        auto options = GifOptions{};
+        options.colorTableMode = ColorTableMode::Global;
+        REQUIRE(getGifBinary(indexed, options) == getGifBinary(image, options));
+    }
+
+    SECTION("palette order")
+    {
+        const auto image = makeNoisyImage(48, 32);
+        auto histogram = ColorHistogram{};
+        for (const auto color : image)
+        {
+            histogram.add(color);
+        }
+        const auto indexed = getIndexedImage(image, getMedianCutPalette(histogram, 256));
+        const auto reordered = getReorderedImage(indexed, getLuminanceOrder(indexed.palette()));
+        const auto binary = getGifBinary(reordered);
+
+        REQUIRE(decodeGif(binary) == decodeGif(getGifBinary(indexed)));
+
+        REQUIRE(binary.size() == getGifBinary(indexed).size());
+    }
+
+    SECTION("small palette")
+    {
+        const auto indexed = IndexedImage{3, 2, {Colors::amber, Colors::azure}, {0, 1, 1, 0, 0, 1}};
+        const auto decoded = decodeGif(getGifBinary(indexed));
+
+        REQUIRE(decoded.size() == 1);
+        REQUIRE(decoded.front()(1, 0) == Color{Colors::azure});
+        REQUIRE(decoded.front()(1, 1) == Color{Colors::amber});
+    }
+
+    SECTION("index outside the palette")
+    {
+        auto indexed = IndexedImage{2, 2, {Colors::amber, Colors::azure}};
+        indexed(1, 1) = 2;
+
+        REQUIRE_THROWS_AS(getGifBinary(indexed), std::invalid_argument);
+    }
+
+    SECTION("empty image")
+    {
+        REQUIRE_THROWS_AS(getGifBinary(IndexedImage{}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("gif global color table")
+{
+    auto options = GifOptions{};
+    options.colorTableMode = ColorTableMode::Global;
+
+    const auto delayCentiseconds = 10;
+    const auto images = makeDashboardFrames(6);
+    const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+    SECTION("animation")
+    {
+        const auto binary = getGifBinary(frames, delayCentiseconds, options);
+
+        REQUIRE(decodeGif(binary) == images);
+
+        REQUIRE(binary.size() < getGifBinary(frames, delayCentiseconds).size());
+    }
+
+    SECTION("delta frames")
+    {
+        options.deltaFrames = true;
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == images);
+    }
+
+    SECTION("sampled frames")
+    {
+        options.globalColorTableFrameStride = static_cast<int>(images.size());
+
+        const auto actual = decodeGif(getGifBinary(frames, delayCentiseconds, options));
+
+        REQUIRE(actual.size() == images.size());
+
+        REQUIRE(actual[0] == images[0]);
+
+        REQUIRE(actual[1] != images[1]);
+    }
+
+    SECTION("single image")
+    {
+        const auto image = makeNoisyImage(30, 20);
+
+        REQUIRE(decodeGif(getGifBinary(image, options)) == std::vector<Image>{{image}});
+    }
+
+    SECTION("writer")
+    {
+        const auto path = std::string{"target/actual_writer_global_animation.gif"};
+
+        auto writer = GifWriter{path, images.front().width(), images.front().height(), options};
+        writer.addFrame(images[0], delayCentiseconds);
+        writer.addFrame(images[2], delayCentiseconds);
+        writer.close();
+
+        options.globalColorTableFrameStride = 2;
+        const auto expected = getGifBinary({&images[0], &images[2]}, delayCentiseconds, options);
+
+        REQUIRE(readBinaryFile(path) == expected);
+    }
+}
+
+TEST_CASE("gif interlacing")
+{
+    auto options = GifOptions{};
+    options.interlaced = true;
+
+    SECTION("image")
+    {
+        const auto image = makeNoisyImage(37, 29);
+        const auto binary = getGifBinary(image, options);
+        const auto progressive = getGifBinary(image);
+
+        REQUIRE(decodeGif(binary) == std::vector<Image>{{image}});
+
+        const auto mismatch = std::mismatch(binary.cbegin(), binary.cend(), progressive.cbegin()).first;
+
+        REQUIRE(mismatch != binary.cend());
+
+        REQUIRE((*mismatch ^ progressive[mismatch - binary.cbegin()]) == 0x40);
+    }
+
+    SECTION("every pass layout")
+    {
+        for (auto height = 1; height <= 9; ++height)
+        {
+            const auto image = makeNoisyImage(5, height);
+
+            REQUIRE(decodeGif(getGifBinary(image, options)) == std::vector<Image>{{image}});
+        }
+    }
+
+    SECTION("animation")
+    {
+        const auto delayCentiseconds = 10;
+        const auto images = makeDashboardFrames(4);
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == images);
+
+        options.deltaFrames = true;
+        options.colorTableMode = ColorTableMode::Global;
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == images);
+    }
+
+    SECTION("indexed image")
+    {
+        const auto indexed =
+            IndexedImage{3, 5, {Colors::red, Colors::blue}, {0, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 1, 1, 0, 1}};
+        const auto decoded = decodeGif(getGifBinary(indexed, options));
+
+        REQUIRE(decoded.size() == 1);
+
+        for (auto y = 0; y < indexed.height(); ++y)
+        {
+            for (auto x = 0; x < indexed.width(); ++x)
+            {
+                REQUIRE(decoded.front()(x, y) == indexed.color(x, y));
+            }
+        }
+    }
+}
+
+// The sprite moves across a noisy background that is hidden by a zero alpha, with a few barely visible pixels.
+static std::vector<Image> makeSpriteFrames(const int framesCount)
+{
+    auto frames = std::vector<Image>{};
+    for (auto index = 0; index < framesCount; ++index)
+    {
+        auto frame = makeNoisyImage(60, 40);
+        for (auto y = 0; y < frame.height(); ++y)
+        {
+            for (auto x = 0; x < frame.width(); ++x)
+            {
+                const auto isSprite = x >= 8 * index && x < 8 * index + 12 && y >= 10 && y < 22;
+                const auto alpha = isSprite ? (x + y) % 5 == 0 ? 130 : 255 : 0;
+                const auto color = frame(x, y);
+                frame(x, y) = Color{color.red(), color.green(), color.blue(), static_cast<Color::value_type>(alpha)};
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+static Image getVisibleImage(const Image& image, const int alphaThreshold)
+{
+    auto visible = image;
+    for (auto& color : visible)
+    {
+        color = color.alpha() < alphaThreshold ? Color{0, 0, 0, 0} : Color{color.red(), color.green(), color.blue()};
+    }
+    return visible;
+}
+
+TEST_CASE("gif transparency")
+{
+    auto options = GifOptions{};
+    options.alphaThreshold = 128;
+
+    const auto images = makeSpriteFrames(5);
+    const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+    const auto visibleImages =
+        images | map([&options](const auto& image) { return getVisibleImage(image, options.alphaThreshold); }) |
+        toVector();
+    const auto delayCentiseconds = 10;
+
+    SECTION("single image")
+    {
+        REQUIRE(decodeGif(getGifBinary(images[1], options)) == std::vector<Image>{{visibleImages[1]}});
+
+        options.colorTableMode = ColorTableMode::Global;
+
+        REQUIRE(decodeGif(getGifBinary(images[1], options)) == std::vector<Image>{{visibleImages[1]}});
+    }
+
+    SECTION("sparse overlay")
+    {
+        REQUIRE(getGifBinary(images[1], options).size() < getGifBinary(images[1]).size() / 4);
+    }
+
+    SECTION("many colors")
+    {
+        auto image = makeGradientImage(64, 64);
+        for (auto y = 0; y < image.height(); ++y)
+        {
+            for (auto x = 0; x < image.width() / 2; ++x)
+            {
+                image(x, y) = Color{image(x, y).red(), image(x, y).green(), image(x, y).blue(), 0};
+            }
+        }
+
+        for (const auto quantizer : {Quantizer::Uniform, Quantizer::MedianCut, Quantizer::Octree})
+        {
+            options.quantizer = quantizer;
+
+            const auto decoded = decodeGif(getGifBinary(image, options));
+
+            REQUIRE(decoded.size() == 1);
+
+            auto misplacedPixelsCount = 0;
+            for (auto y = 0; y < image.height(); ++y)
+            {
+                for (auto x = 0; x < image.width(); ++x)
+                {
+                    misplacedPixelsCount += (decoded.front()(x, y).alpha() == 0) != (x < image.width() / 2);
+                }
+            }
+
+            REQUIRE(misplacedPixelsCount == 0);
+        }
+    }
+
+    SECTION("animation")
+    {
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == visibleImages);
+
+        options.colorTableMode = ColorTableMode::Global;
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == visibleImages);
+    }
+
+    SECTION("delta frames")
+    {
+        options.deltaFrames = true;
+
+        const auto binary = getGifBinary(frames, delayCentiseconds, options);
+
+        REQUIRE(decodeGif(binary) == visibleImages);
+
+        options.colorTableMode = ColorTableMode::Global;
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == visibleImages);
+
+        options.threadsCount = 3;
+
+        REQUIRE(decodeGif(getGifBinary(frames, delayCentiseconds, options)) == visibleImages);
+    }
+
+    SECTION("writer")
+    {
+        options.deltaFrames = true;
+
+        auto sink = MemorySink{};
+        auto writer = GifWriter{sink, images.front().width(), images.front().height(), options};
+        for (const auto& image : images)
+        {
+            writer.addFrame(image, delayCentiseconds);
+        }
+        writer.close();
+
+        REQUIRE(sink.bytes() == getGifBinary(frames, delayCentiseconds, options));
+    }
+}
+
+static int getLargestPixelDistance(const Image& expected, const Image& actual)
+{
+    auto largestDistance = 0;
+    for (auto position = 0; position < static_cast<int>(expected.size()); ++position)
+    {
+        const auto red = expected.cbegin()[position].red() - actual.cbegin()[position].red();
+        const auto green = expected.cbegin()[position].green() - actual.cbegin()[position].green();
+        const auto blue = expected.cbegin()[position].blue() - actual.cbegin()[position].blue();
+        largestDistance = std::max(largestDistance, red * red + green * green + blue * blue);
+    }
+    return largestDistance;
+}
+
+TEST_CASE("gif lossy lzw")
+{
+    auto options = GifOptions{};
+    options.quantizer = Quantizer::MedianCut;
+    options.dithering = Dithering::FloydSteinberg;
+
+    const auto image = makeGradientImage(160, 120);
+    const auto exact = getGifBinary(image, options);
+    const auto exactImage = decodeGif(exact).front();
+
+    SECTION("error is bounded per pixel")
+    {
+        for (const auto lossiness : {20, 40})
+        {
+            options.lossiness = lossiness;
+
+            const auto binary = getGifBinary(image, options);
+
+            REQUIRE(binary.size() < exact.size());
+
+            REQUIRE(getLargestPixelDistance(exactImage, decodeGif(binary).front()) <= lossiness * lossiness);
+        }
+    }
+
+    SECTION("larger lossiness compresses better")
+    {
+        options.lossiness = 10;
+        const auto slightlyLossy = getGifBinary(image, options);
+
+        options.lossiness = 40;
+        const auto lossy = getGifBinary(image, options);
+
+        REQUIRE(lossy.size() < slightlyLossy.size());
+    }
+
+    SECTION("transparent pixels stay transparent")
+    {
+        options.alphaThreshold = 128;
+        options.lossiness = 255;
+
+        const auto sprite = makeSpriteFrames(2)[1];
+        const auto decoded = decodeGif(getGifBinary(sprite, options)).front();
+
+        auto misplacedPixelsCount = 0;
+        for (auto position = 0; position < static_cast<int>(sprite.size()); ++position)
+        {
+            misplacedPixelsCount += (sprite.cbegin()[position].alpha() < options.alphaThreshold) !=
+                                    (decoded.cbegin()[position].alpha() == 0);
+        }
+
+        REQUIRE(misplacedPixelsCount == 0);
+    }
+
+    SECTION("animation")
+    {
+        options.lossiness = 20;
+        options.deltaFrames = true;
+        options.interlaced = true;
+
+        const auto images = makeDashboardFrames(3);
+        const auto frames = images | map([](const auto& frame) { return &frame; }) | toVector();
+        const auto decoded = decodeGif(getGifBinary(frames, 10, options));
+
+        REQUIRE(decoded.size() == images.size());
+
+        for (auto index = 0; index < static_cast<int>(images.size()); ++index)
+        {
+            REQUIRE(getLargestPixelDistance(images[index], decoded[index]) <= 20 * 20);
+        }
+    }
+}
+
+TEST_CASE("gif frame delays")
+{
+    const auto noisy = makeNoisyImage(40, 30);
+    const auto gradient = makeGradientImage(40, 30);
+    const auto frames = std::vector<const Image*>{&noisy, &noisy, &gradient, &gradient, &gradient, &noisy};
+    const auto delaysCentiseconds = std::vector<int>{10, 20, 30, 40, 50, 60};
+
+    auto options = GifOptions{};
+
+    SECTION("per frame delays")
+    {
+        REQUIRE(getGifBinary(frames, std::vector<int>(frames.size(), 25)) == getGifBinary(frames, 25));
+
+        REQUIRE(decodeGif(getGifBinary(frames, delaysCentiseconds)) == decodeGif(getGifBinary(frames, 25)));
+    }
+
+    SECTION("invalid delays")
+    {
+        REQUIRE_THROWS_AS(getGifBinary(frames, std::vector<int>{10, 20}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary({&noisy}, std::vector<int>{-1}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary({&noisy}, std::vector<int>{70000}), std::invalid_argument);
+    }
+
+    SECTION("merged frames")
+    {
+        const auto expected = getGifBinary({&noisy, &gradient, &noisy}, std::vector<int>{30, 120, 60}, options);
+
+        options.mergeIdenticalFrames = true;
+
+        REQUIRE(getGifBinary(frames, delaysCentiseconds, options) == expected);
+
+        options.threadsCount = 4;
+
+        REQUIRE(getGifBinary(frames, delaysCentiseconds, options) == expected);
+    }
+
+    SECTION("merged delta frames")
+    {
+        options.deltaFrames = true;
+        const auto expected = getGifBinary({&noisy, &gradient, &noisy}, std::vector<int>{30, 120, 60}, options);
+
+        options.mergeIdenticalFrames = true;
+
+        REQUIRE(getGifBinary(frames, delaysCentiseconds, options) == expected);
+    }
+
+    SECTION("merged delay overflow")
+    {
+        options.mergeIdenticalFrames = true;
+
+        const auto binary = getGifBinary({&noisy, &noisy, &noisy}, std::vector<int>{40000, 20000, 10000}, options);
+
+        REQUIRE(binary == getGifBinary({&noisy, &noisy}, std::vector<int>{60000, 10000}));
+    }
+
+    SECTION("writer")
+    {
+        options.mergeIdenticalFrames = true;
+
+        auto sink = MemorySink{};
+        auto writer = GifWriter{sink, noisy.width(), noisy.height(), options};
+        for (auto index = 0; index < static_cast<int>(frames.size()); ++index)
+        {
+            writer.addFrame(*frames[index], delaysCentiseconds[index]);
+        }
+        writer.close();
+
+        REQUIRE(sink.bytes() == getGifBinary(frames, delaysCentiseconds, options));
+
+        REQUIRE(decodeGif(sink.bytes()).size() == 3);
+    }
+}
+
+TEST_CASE("gif frame descriptors")
+{
+    const auto background = makeNoisyImage(40, 30);
+    const auto square = Image{10, 10, Colors::amber};
+    const auto transparent = Color{0, 0, 0, 0};
+
+    const auto drawSquare = [&square](Image image, const int x0, const int y0, const Color color)
+    {
+        for (auto y = y0; y < y0 + square.height(); ++y)
+        {
+            for (auto x = x0; x < x0 + square.width(); ++x)
+            {
+                image(x, y) = color;
+            }
+        }
+        return image;
+    };
+
+    SECTION("full screen frames")
+    {
+        const auto gradient = makeGradientImage(40, 30);
+        const auto frames = std::vector<GifFrame>{{&background, 10}, {&gradient, 70}};
+
+        REQUIRE(getGifBinary(40, 30, frames) == getGifBinary({&background, &gradient}, std::vector<int>{10, 70}));
+    }
+
+    SECTION("offsets and disposal")
+    {
+        const auto frames =
+            std::vector<GifFrame>{{&background, 10, DisposalMethod::DoNotDispose},
+                                  {&square, 20, DisposalMethod::RestoreToBackgroundColor, 5, 7},
+                                  {&square, 30, DisposalMethod::RestoreToPrevious, 20, 10},
+                                  {&square, 40, DisposalMethod::NotSpecified, 30, 20}};
+
+        const auto decoded = decodeGif(getGifBinary(40, 30, frames));
+
+        REQUIRE(decoded.size() == 4);
+
+        REQUIRE(decoded[0] == background);
+
+        REQUIRE(decoded[1] == drawSquare(background, 5, 7, Colors::amber));
+
+        const auto cleared = drawSquare(background, 5, 7, transparent);
+
+        REQUIRE(decoded[2] == drawSquare(cleared, 20, 10, Colors::amber));
+
+        REQUIRE(decoded[3] == drawSquare(cleared, 30, 20, Colors::amber));
+    }
+
+    SECTION("global color table")
+    {
+        auto options = GifOptions{};
+        options.colorTableMode = ColorTableMode::Global;
+
+        const auto frames =
+            std::vector<GifFrame>{{&background, 10, DisposalMethod::DoNotDispose}, {&square, 20, {}, 12, 3}};
+        const auto decoded = decodeGif(getGifBinary(40, 30, frames, options));
+
+        REQUIRE(decoded.back() == drawSquare(background, 12, 3, Colors::amber));
+    }
+
+    SECTION("invalid frames")
+    {
+        REQUIRE_THROWS_AS(getGifBinary(40, 30, {{&square, 10, {}, 31, 0}}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary(40, 30, {{&square, 10, {}, -1, 0}}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary(40, 30, {{nullptr, 10}}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary(0, 30, {{&square, 10}}), std::invalid_argument);
+
+        REQUIRE_THROWS_AS(getGifBinary(40, 30, std::vector<GifFrame>{}), std::invalid_argument);
+    }
+
+    SECTION("loop count")
+    {
+        const auto netscape = std::string_view{"NETSCAPE2.0"};
+        const auto findLoopCount = [&netscape](const std::vector<uint8_t>& binary)
+        {
+            const auto extension = std::search(binary.cbegin(), binary.cend(), netscape.cbegin(), netscape.cend());
+            if (extension == binary.cend())
+            {
+                return -1;
+            }
+            const auto count = extension + netscape.size() + 2;
+            return count[0] | (count[1] << 8);
+        };
+
+        auto options = GifOptions{};
+
+        REQUIRE(findLoopCount(getGifBinary(40, 30, {{&background, 10}}, options)) == 0);
+
+        options.loopCount = 3;
+
+        REQUIRE(findLoopCount(getGifBinary(40, 30, {{&background, 10}}, options)) == 3);
+
+        REQUIRE(findLoopCount(getGifBinary({&background}, 10, options)) == 3);
+
+        options.loopCount = -1;
+
+        REQUIRE(findLoopCount(getGifBinary(40, 30, {{&background, 10}}, options)) == -1);
+
+        REQUIRE(decodeGif(getGifBinary(40, 30, {{&background, 10}}, options)) == std::vector<Image>{{background}});
+
+        options.loopCount = 70000;
+
+        REQUIRE_THROWS_AS(getGifBinary(40, 30, {{&background, 10}}, options), std::invalid_argument);
+    }
+}
+
+TEST_CASE("gif effort")
+{
+    const auto images = makeDashboardFrames(4);
+    const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+    const auto delayCentiseconds = 10;
+
+    const auto fastest = getGifBinary(frames, delayCentiseconds, getEffortOptions(Effort::Fastest));
+    const auto balanced = getGifBinary(frames, delayCentiseconds, getEffortOptions(Effort::Balanced));
+    const auto smallest = getGifBinary(frames, delayCentiseconds, getEffortOptions(Effort::Smallest));
+
+    REQUIRE(decodeGif(fastest) == images);
+
+    REQUIRE(decodeGif(balanced) == images);
+
+    REQUIRE(decodeGif(smallest) == images);
+
+    REQUIRE(balanced.size() < fastest.size());
+}
+
+TEST_CASE("gif bands")
+{
+    SECTION("round trip")
+    {
+        const auto image = makeNoisyImage(50, 37);
+        auto options = GifOptions{};
+        options.bandHeight = 8;
+
+        const auto decoded = decodeGif(getGifBinary(image, options));
+
+        REQUIRE(decoded.size() == 5);
+
+        REQUIRE(decoded.back() == image);
+    }
+
+    SECTION("matches global color table")
+    {
+        const auto image = makeGradientImage(64, 48);
+        auto options = GifOptions{};
+        options.colorTableMode = ColorTableMode::Global;
+        options.quantizer = Quantizer::MedianCut;
+
+        const auto expected = decodeGif(getGifBinary(image, options)).back();
+
+        options.bandHeight = 10;
+        options.threadsCount = 1;
+        const auto binary = getGifBinary(image, options);
+
+        REQUIRE(decodeGif(binary).back() == expected);
+
+        options.threadsCount = 4;
+
+        REQUIRE(getGifBinary(image, options) == binary);
+    }
+
+    SECTION("single band")
+    {
+        const auto image = makeNoisyImage(30, 20);
+        auto options = GifOptions{};
+        options.bandHeight = 20;
+
+        REQUIRE(getGifBinary(image, options) == getGifBinary(image));
+    }
+
+    SECTION("negative band height")
+    {
+        auto options = GifOptions{};
+        options.bandHeight = -1;
+
+        REQUIRE_THROWS_AS(getGifBinary(makeNoisyImage(30, 20), options), std::invalid_argument);
+    }
+}
+
+TEST_CASE("gif writer")
+{
+    const auto images = std::vector<Image>{{makeNoisyImage(40, 30), Image{40, 30, Colors::amber},
+                                            makeGradientImage(40, 30)}};
+    const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+    const auto delayCentiseconds = 25;
+    const auto path = std::string{"target/actual_writer_animation.gif"};
+
+    SECTION("matches in-memory encoding")
+    {
+        auto writer = GifWriter{path, 40, 30};
+        for (const auto& image : images)
+        {
+            writer.addFrame(image, delayCentiseconds);
+        }
+        writer.close();
+
+        REQUIRE(readBinaryFile(path) == getGifBinary(frames, delayCentiseconds));
+    }
+
+    SECTION("closes on destruction")
+    {
+        {
+            auto writer = GifWriter{path, 40, 30};
+            writer.addFrame(images.front(), delayCentiseconds);
+        }
+
+        REQUIRE(readGifFile(path) == std::vector<Image>{{images.front()}});
+    }
+
+    SECTION("frame size mismatch")
+    {
+        auto writer = GifWriter{path, 40, 30};
+
+        REQUIRE_THROWS_AS(writer.addFrame(Image{30, 40}, delayCentiseconds), std::invalid_argument);
+    }
+
+    SECTION("closed writer")
+    {
+        auto writer = GifWriter{path, 40, 30};
+        writer.close();
+
+        REQUIRE_THROWS_AS(writer.addFrame(images.front(), delayCentiseconds), std::logic_error);
+    }
+
+    SECTION("sink")
+    {
+        auto sink = MemorySink{};
+        {
+            auto writer = GifWriter{sink, 40, 30};
+            for (const auto& image : images)
+            {
+                writer.addFrame(image, delayCentiseconds);
+            }
+        }
+
+        REQUIRE(sink.bytes() == getGifBinary(frames, delayCentiseconds));
+    }
+}
+
+TEST_CASE("gif sink")
+{
+    auto chunkSizes = std::vector<size_t>{};
+    auto actual = std::vector<uint8_t>{};
+    auto sink = CallbackSink{[&](const uint8_t* bytes, const size_t count)
+                             {
+                                 chunkSizes.push_back(count);
+                                 actual.insert(actual.end(), bytes, bytes + count);
+                             }};
+
+    SECTION("large image")
+    {
+        const auto image = makeNoisyImage(1024, 512);
+        writeGifBinary(sink, image);
+
+        REQUIRE(actual == getGifBinary(image));
+        REQUIRE(chunkSizes.size() > 1);
+        REQUIRE(*std::max_element(chunkSizes.cbegin(), chunkSizes.cend()) < 2 * SinkBuffer::defaultCapacity);
+    }
+
+    SECTION("animation")
+    {
+        const auto images = makeDashboardFrames(6);
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+
+        for (const auto threadsCount : {1, 4})
+        {
+            auto options = GifOptions{};
+            options.threadsCount = threadsCount;
+
+            actual.clear();
+            writeGifBinary(sink, frames, 10, options);
+
+            REQUIRE(actual == getGifBinary(frames, 10));
+        }
+    }
+
+    SECTION("indexed image")
+    {
+        const auto image = IndexedImage{2, 2, {Colors::amber, Colors::azure}, {0, 1, 1, 0}};
+        writeGifBinary(sink, image);
+
+        REQUIRE(actual == getGifBinary(image));
+    }
+
+    SECTION("invalid input leaves the file untouched")
+    {
+        const auto path = std::string{"target/actual_invalid.gif"};
+        const auto previous = getGifBinary(makeNoisyImage(4, 4));
+        writeBinaryFile(path, previous);
+
+        const auto image = makeNoisyImage(4, 4);
+        const auto frames = std::vector<const Image*>{&image, &image};
+
+        REQUIRE_THROWS_AS(writeGifFile(path, {}, 10, GifOptions{}), std::invalid_argument);
+        REQUIRE_THROWS_AS(writeGifFile(path, frames, std::vector<int>{10, -1}), std::invalid_argument);
+        REQUIRE_THROWS_AS(writeGifFile(path, Image{}), std::invalid_argument);
+        const auto outside = GifFrame{&image, 10, DisposalMethod::NotSpecified, 1, 0};
+        REQUIRE_THROWS_AS(writeGifFile(path, 4, 4, {outside}), std::invalid_argument);
+
+        REQUIRE(readBinaryFile(path) == previous);
+    }
+}
+
+TEST_CASE("gif decoder")
+{
+    SECTION("rgb")
+    {
+        auto expected = Image{2, 3};
+        expected(0, 0) = Colors::red;
+        expected(1, 0) = Colors::green;
+        expected(0, 1) = Colors::blue;
+        expected(1, 1) = Colors::magenta;
+        expected(0, 2) = Colors::pink;
+        expected(1, 2) = Colors::darkGreen;
+
+        const auto actual = readGifFile("resources/dansandu/canvas/expected_rgb.gif");
+
+        REQUIRE(actual == std::vector<Image>{{expected}});
+    }
+
+    SECTION("large animation")
+    {
+        const auto actual = readGifFile("resources/dansandu/canvas/expected_animation.gif");
+
+        REQUIRE(actual.size() == 9);
+
+        for (auto index = 0; index < static_cast<int>(actual.size()); ++index)
+        {
+            const auto path = "resources/dansandu/canvas/frame" + std::to_string(index) + ".bmp";
+
+            REQUIRE(actual[index] == readBitmapFile(path));
+        }
+    }
+
+    SECTION("round trip")
+    {
+        const auto images = std::vector<Image>{{makeNoisyImage(300, 200), Image{300, 200, Colors::amber},
+                                                Image{300, 200, Colors::blue}}};
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+        const auto periodCentiseconds = 10;
+
+        REQUIRE(decodeGif(getGifBinary(frames, periodCentiseconds)) == images);
+    }
+
+    SECTION("truncated binary")
+    {
+        auto binary = readBinaryFile("resources/dansandu/canvas/expected_image.gif");
+        binary.resize(binary.size() / 2);
+
+        REQUIRE_THROWS_AS(decodeGif(binary), GifReadException);
+    }
+
+    SECTION("invalid signature")
+    {
+        auto binary = readBinaryFile("resources/dansandu/canvas/expected_rgb.gif");
+        binary[0] = 'J';
+
+        REQUIRE_THROWS_AS(decodeGif(binary), GifReadException);
+    }
+}
+
+TEST_CASE("gif benchmark", "[.benchmark]")
+{
+    SECTION("lzw large frame throughput")
+    {
+        const auto width = 1920;
+        const auto height = 1080;
+
+        auto input = std::vector<int>(width * height);
+        auto seed = 1U;
+        for (auto y = 0; y < height; ++y)
+        {
+            for (auto x = 0; x < width; ++x)
+            {
+                seed = seed * 1103515245U + 12345U;
+                input[x + y * width] = ((x + y) / 16 + ((seed >> 16) & 0x03)) & 0xFF;
+            }
+        }
+
+        const auto alphabetSize = 256;
+        const auto repetitions = 10;
+
+        auto encodedBytes = 0ULL;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto repetition = 0; repetition < repetitions; ++repetition)
+        {
+            encodedBytes += lzw(input, alphabetSize).first.size();
+        }
+        const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+        REQUIRE(encodedBytes > 0ULL);
+
+        WARN("lzw encoded " << width << "x" << height << " frames at " << repetitions * input.size() / seconds / 1.0e6
+                            << " Mpixels/s");
+    }
+
+    SECTION("adaptive clear code size")
+    {
+        auto options = GifOptions{};
+        options.adaptiveClearCode = true;
+
+        const auto images = std::vector<std::pair<std::string, Image>>{{"noisy", makeNoisyImage(1024, 1024)},
+                                                                       {"gradient", makeGradientImage(1024, 1024)}};
+        for (const auto& [name, image] : images)
+        {
+            const auto defaultSize = getGifBinary(image).size();
+            const auto adaptiveSize = getGifBinary(image, options).size();
+
+            WARN(name << " image is " << adaptiveSize << " bytes with adaptive clear code and " << defaultSize
+                      << " bytes without");
+        }
+    }
+
+    SECTION("decoder throughput")
+    {
+        const auto paths = {"resources/dansandu/canvas/expected_image.gif",
+                            "resources/dansandu/canvas/expected_animation.gif"};
+        for (const auto path : paths)
+        {
+            const auto binary = readBinaryFile(path);
+            const auto repetitions = 200;
+
+            auto pixels = 0ULL;
+            const auto start = std::chrono::steady_clock::now();
+            for (auto repetition = 0; repetition < repetitions; ++repetition)
+            {
+                for (const auto& frame : decodeGif(binary))
+                {
+                    pixels += frame.size();
+                }
+            }
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            REQUIRE(pixels > 0ULL);
+
+            WARN("decoded " << path << " at " << pixels * sizeof(Color) / seconds / 1.0e6 << " MB/s of pixels");
+        }
+    }
+
+    SECTION("parallel animation encoding")
+    {
+        const auto images = std::vector<Image>(32, makeNoisyImage(640, 480));
+        const auto frames = images | map([](const auto& image) { return &image; }) | toVector();
+        const auto delayCentiseconds = 4;
+
+        for (const auto threadsCount : {1, 2, 4, 0})
+        {
+            auto options = GifOptions{};
+            options.threadsCount = threadsCount;
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto binary = getGifBinary(frames, delayCentiseconds, options);
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            REQUIRE(!binary.empty());
+
+            WARN("encoded " << frames.size() << " frames with " << threadsCount << " threads in " << seconds << " s");
+        }
+    }
+
+    SECTION("photographic image encoding")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        const auto repetitions = 50;
+
+        auto encodedBytes = 0ULL;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto repetition = 0; repetition < repetitions; ++repetition)
+        {
+            encodedBytes += getGifBinary(image).size();
+        }
+        const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+        REQUIRE(encodedBytes > 0ULL);
+
+        WARN("encoded " << image.width() << "x" << image.height() << " photographic image at "
+                        << repetitions * image.size() / seconds / 1.0e6 << " Mpixels/s");
+    }
+
+    SECTION("dithering throughput")
+    {
+        const auto image = makeGradientImage(1024, 1024);
+        const auto repetitions = 5;
+
+        for (const auto dithering : {Dithering::None, Dithering::FloydSteinberg, Dithering::Ordered})
+        {
+            auto options = GifOptions{};
+            options.dithering = dithering;
+            options.threadsCount = 0;
+
+            auto binary = std::vector<uint8_t>{};
+            const auto start = std::chrono::steady_clock::now();
+            for (auto repetition = 0; repetition < repetitions; ++repetition)
+            {
+                binary = getGifBinary(image, options);
+            }
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            WARN("dithering " << static_cast<int>(dithering) << " encoded at "
+                              << repetitions * image.size() / seconds / 1.0e6 << " Mpixels/s with block error "
+                              << getBlockMeanSquaredError(image, decodeGif(binary).front()));
+        }
+    }
+
+    SECTION("lossy lzw size and quality")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        const auto repetitions = 20;
+
+        auto options = GifOptions{};
+        options.quantizer = Quantizer::MedianCut;
+        options.dithering = Dithering::FloydSteinberg;
+
+        for (const auto lossiness : {0, 10, 20, 40, 80})
+        {
+            options.lossiness = lossiness;
+
+            auto binary = std::vector<uint8_t>{};
+            const auto start = std::chrono::steady_clock::now();
+            for (auto repetition = 0; repetition < repetitions; ++repetition)
+            {
+                binary = getGifBinary(image, options);
+            }
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            WARN("lossiness " << lossiness << " encoded at " << repetitions * image.size() / seconds / 1.0e6
+                              << " Mpixels/s into " << binary.size() << " bytes with mean squared error "
+                              << getMeanSquaredError(image, decodeGif(binary).front()));
+        }
+    }
+
+    SECTION("static stretch")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        const auto frames = std::vector<const Image*>(60, &image);
+
+        for (const auto merge : {false, true})
+        {
+            auto options = GifOptions{};
+            options.mergeIdenticalFrames = merge;
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto binary = getGifBinary(frames, 4, options);
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            WARN("merging " << merge << " encoded " << frames.size() << " identical frames in " << seconds * 1.0e3
+                            << " ms into " << binary.size() << " bytes");
+        }
+    }
+
+    SECTION("banded single image")
+    {
+        const auto tile = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        auto image = Image{6 * tile.width(), 4 * tile.height()};
+        for (auto y = 0; y < image.height(); ++y)
+        {
+            for (auto x = 0; x < image.width(); ++x)
+            {
+                image(x, y) = tile(x % tile.width(), y % tile.height());
+            }
+        }
+
+        for (const auto quantizer : {Quantizer::Uniform, Quantizer::MedianCut})
+        {
+            for (const auto bandHeight : {0, 64})
+            {
+                auto options = GifOptions{};
+                options.quantizer = quantizer;
+                options.bandHeight = bandHeight;
+                options.threadsCount = 0;
+
+                const auto start = std::chrono::steady_clock::now();
+                const auto binary = getGifBinary(image, options);
+                const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+                WARN("quantizer " << static_cast<int>(quantizer) << " with band height " << bandHeight << " encoded "
+                                  << image.width() << "x" << image.height() << " image in " << seconds * 1.0e3
+                                  << " ms into " << binary.size() << " bytes");
+            }
+        }
+    }
+
+    SECTION("palette order size")
+    {
+        for (const auto name : {"expected_flower", "expected_rgb", "expected_chessboard", "frame0"})
+        {
+            const auto image = readBitmapFile(std::string{"resources/dansandu/canvas/"} + name + ".bmp");
+            auto histogram = ColorHistogram{};
+            for (const auto color : image)
+            {
+                histogram.add(color);
+            }
+            const auto indexed = getIndexedImage(image, getMedianCutPalette(histogram, 256));
+
+            auto frequencies = std::vector<int>(indexed.palette().size());
+            for (const auto index : indexed)
+            {
+                ++frequencies[index];
+            }
+            auto frequencyOrder = std::vector<int>(frequencies.size());
+            std::iota(frequencyOrder.begin(), frequencyOrder.end(), 0);
+            std::stable_sort(frequencyOrder.begin(), frequencyOrder.end(),
+                             [&frequencies](const auto lhs, const auto rhs)
+                             { return frequencies[lhs] > frequencies[rhs]; });
+
+            const auto quantizerSize = getGifBinary(indexed).size();
+            const auto luminanceOrder = getLuminanceOrder(indexed.palette());
+            const auto luminanceSize = getGifBinary(getReorderedImage(indexed, luminanceOrder)).size();
+            const auto frequencySize = getGifBinary(getReorderedImage(indexed, frequencyOrder)).size();
+
+            WARN(name << " with " << indexed.palette().size() << " colors encoded into " << quantizerSize
+                      << " bytes in quantizer order, " << luminanceSize << " bytes in luminance order and "
+                      << frequencySize << " bytes in frequency order");
+        }
+    }
+
+    SECTION("quantizer throughput and quality")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+        const auto repetitions = 20;
+
+        for (const auto quantizer : {Quantizer::Uniform, Quantizer::MedianCut, Quantizer::Octree})
+        {
+            auto options = GifOptions{};
+            options.quantizer = quantizer;
+
+            auto binary = std::vector<uint8_t>{};
+            const auto start = std::chrono::steady_clock::now();
+            for (auto repetition = 0; repetition < repetitions; ++repetition)
+            {
+                binary = getGifBinary(image, options);
+            }
+            const auto seconds = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count();
+
+            WARN("quantizer " << static_cast<int>(quantizer) << " encoded at "
+                              << repetitions * image.size() / seconds / 1.0e6 << " Mpixels/s with mean squared error "
+                              << getMeanSquaredError(image, decodeGif(binary).front()));
+        }
     }
 }
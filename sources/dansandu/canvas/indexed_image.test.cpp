@@ -0,0 +1,48 @@
+#include "dansandu/canvas/indexed_image.hpp"
+#include "catchorg/catch/catch.hpp"
+
+#include <cstdint>
+
+using dansandu::canvas::color::Color;
+using dansandu::canvas::color::Colors;
+using dansandu::canvas::indexed_image::IndexedImage;
+
+TEST_CASE("indexed image")
+{
+    SECTION("empty")
+    {
+        auto image = IndexedImage{};
+
+        REQUIRE(image.width() == 0);
+        REQUIRE(image.height() == 0);
+        REQUIRE(image.empty());
+    }
+
+    SECTION("solid")
+    {
+        auto image = IndexedImage{10, 20, {Colors::fuchsia, Colors::magenta}};
+
+        SECTION("indexing within bounds")
+        {
+            image(5, 5) = 1;
+
+            REQUIRE(image(5, 5) == 1);
+            REQUIRE(image.color(5, 5) == Colors::magenta);
+            REQUIRE(image.color(4, 5) == Colors::fuchsia);
+        }
+
+        SECTION("indexing outside bounds")
+        {
+            REQUIRE_THROWS_AS(image(10, 20), std::out_of_range);
+            REQUIRE_THROWS_AS(image(15, 10), std::out_of_range);
+        }
+    }
+
+    SECTION("invalid")
+    {
+        REQUIRE_THROWS_AS((IndexedImage{2, 2, {Colors::cadet}, {0, 0, 0}}), std::invalid_argument);
+        REQUIRE_THROWS_AS((IndexedImage{2, 2, {}}), std::invalid_argument);
+        REQUIRE_THROWS_AS((IndexedImage{2, 2, std::vector<Color>(257, Colors::cadet)}), std::invalid_argument);
+        REQUIRE_THROWS_AS((IndexedImage{2, 1, {Colors::cadet, Colors::bronze}, {0, 2}}), std::invalid_argument);
+    }
+}
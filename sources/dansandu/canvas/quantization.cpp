@@ -0,0 +1,339 @@
+#include "dansandu/canvas/quantization.hpp"
+#include "dansandu/ballotin/exception.hpp"
+#include "dansandu/canvas/color.hpp"
+#include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/indexed_image.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+using dansandu::canvas::color::Color;
+using dansandu::canvas::image::Image;
+using dansandu::canvas::indexed_image::IndexedImage;
+
+namespace dansandu::canvas::quantization
+{
+
+static constexpr auto channelsCount = 3;
+
+InversePalette::InversePalette(std::vector<Color> palette)
+    : palette_{std::move(palette)}, lookup_(ColorHistogram::binsCount, -1)
+{
+    if (palette_.empty() || palette_.size() > static_cast<size_t>(std::numeric_limits<int16_t>::max()))
+    {
+        THROW(std::invalid_argument, "inverse palette size ", palette_.size(), " is out of range");
+    }
+}
+
+int InversePalette::findNearest(const int bin) const
+{
+    constexpr auto bits = ColorHistogram::bitsPerChannel;
+    constexpr auto mask = (1 << bits) - 1;
+    constexpr auto shift = 8 - bits;
+    constexpr auto halfBin = 1 << (shift - 1);
+
+    const auto red = (((bin >> (2 * bits)) & mask) << shift) | halfBin;
+    const auto green = (((bin >> bits) & mask) << shift) | halfBin;
+    const auto blue = ((bin & mask) << shift) | halfBin;
+
+    auto nearestIndex = 0;
+    auto nearestDistance = std::numeric_limits<int>::max();
+    for (auto index = 0; index < static_cast<int>(palette_.size()); ++index)
+    {
+        const auto redDistance = palette_[index].red() - red;
+        const auto greenDistance = palette_[index].green() - green;
+        const auto blueDistance = palette_[index].blue() - blue;
+        const auto distance = redDistance * redDistance + greenDistance * greenDistance + blueDistance * blueDistance;
+        if (distance < nearestDistance)
+        {
+            nearestIndex = index;
+            nearestDistance = distance;
+        }
+    }
+    return nearestIndex;
+}
+
+static Color getAverageColor(const uint64_t count, const uint64_t red, const uint64_t green, const uint64_t blue)
+{
+    return Color{static_cast<Color::value_type>((red + count / 2) / count),
+                 static_cast<Color::value_type>((green + count / 2) / count),
+                 static_cast<Color::value_type>((blue + count / 2) / count)};
+}
+
+static void validateColorsCount(const int maximumColorsCount)
+{
+    if (maximumColorsCount < 1)
+    {
+        THROW(std::invalid_argument, "palette size ", maximumColorsCount, " must be at least one");
+    }
+}
+
+struct MedianCutEntry
+{
+    double channels[channelsCount];
+    uint64_t count;
+    uint64_t red;
+    uint64_t green;
+    uint64_t blue;
+};
+
+struct MedianCutBox
+{
+    int begin;
+    int end;
+    int axis;
+    double error;
+};
+
+static MedianCutBox makeMedianCutBox(const std::vector<MedianCutEntry>& entries, const int begin, const int end)
+{
+    double sums[channelsCount] = {};
+    double squareSums[channelsCount] = {};
+    auto count = 0.0;
+
+    for (auto index = begin; index < end; ++index)
+    {
+        const auto& entry = entries[index];
+        for (auto channel = 0; channel < channelsCount; ++channel)
+        {
+            sums[channel] += entry.count * entry.channels[channel];
+            squareSums[channel] += entry.count * entry.channels[channel] * entry.channels[channel];
+        }
+        count += entry.count;
+    }
+
+    auto box = MedianCutBox{begin, end, 0, 0.0};
+    auto largestError = -1.0;
+    for (auto channel = 0; channel < channelsCount; ++channel)
+    {
+        const auto error = squareSums[channel] - sums[channel] * sums[channel] / count;
+        box.error += error;
+        if (error > largestError)
+        {
+            largestError = error;
+            box.axis = channel;
+        }
+    }
+
+    if (end - begin < 2)
+    {
+        box.error = 0.0;
+    }
+
+    return box;
+}
+
+std::vector<Color> getMedianCutPalette(const ColorHistogram& histogram, const int maximumColorsCount)
+{
+    validateColorsCount(maximumColorsCount);
+
+    auto entries = std::vector<MedianCutEntry>{};
+    for (const auto& bin : histogram.bins())
+    {
+        if (bin.count > 0)
+        {
+            const auto count = static_cast<double>(bin.count);
+            entries.push_back({{bin.red / count, bin.green / count, bin.blue / count},
+                               bin.count,
+                               bin.red,
+                               bin.green,
+                               bin.blue});
+        }
+    }
+
+    if (entries.empty())
+    {
+        return {};
+    }
+
+    const auto entriesCount = static_cast<int>(entries.size());
+    auto boxes = std::vector<MedianCutBox>{makeMedianCutBox(entries, 0, entriesCount)};
+
+    // The box with the largest squared error gains the most from being split.
+    while (static_cast<int>(boxes.size()) < maximumColorsCount)
+    {
+        const auto box = std::max_element(boxes.begin(), boxes.end(),
+                                          [](const auto& lhs, const auto& rhs) { return lhs.error < rhs.error; });
+        if (box->error <= 0.0)
+        {
+            break;
+        }
+
+        const auto begin = box->begin;
+        const auto end = box->end;
+        const auto axis = box->axis;
+
+        std::sort(entries.begin() + begin, entries.begin() + end,
+                  [axis](const auto& lhs, const auto& rhs) { return lhs.channels[axis] < rhs.channels[axis]; });
+
+        auto total = uint64_t{0};
+        for (auto index = begin; index < end; ++index)
+        {
+            total += entries[index].count;
+        }
+
+        auto middle = begin + 1;
+        for (auto cumulative = entries[begin].count; 2 * cumulative < total && middle < end - 1; ++middle)
+        {
+            cumulative += entries[middle].count;
+        }
+
+        *box = makeMedianCutBox(entries, begin, middle);
+        boxes.push_back(makeMedianCutBox(entries, middle, end));
+    }
+
+    auto palette = std::vector<Color>{};
+    for (const auto& box : boxes)
+    {
+        auto count = uint64_t{0};
+        auto red = uint64_t{0};
+        auto green = uint64_t{0};
+        auto blue = uint64_t{0};
+        for (auto index = box.begin; index < box.end; ++index)
+        {
+            count += entries[index].count;
+            red += entries[index].red;
+            green += entries[index].green;
+            blue += entries[index].blue;
+        }
+        palette.push_back(getAverageColor(count, red, green, blue));
+    }
+
+    return palette;
+}
+
+struct OctreeNode
+{
+    uint64_t count;
+    uint64_t red;
+    uint64_t green;
+    uint64_t blue;
+    int children[8];
+    bool isLeaf;
+};
+
+std::vector<Color> getOctreePalette(const ColorHistogram& histogram, const int maximumColorsCount)
+{
+    validateColorsCount(maximumColorsCount);
+
+    constexpr auto depth = ColorHistogram::bitsPerChannel;
+    constexpr auto noChild = -1;
+
+    const auto makeNode = []() { return OctreeNode{0, 0, 0, 0, {-1, -1, -1, -1, -1, -1, -1, -1}, false}; };
+
+    auto nodes = std::vector<OctreeNode>{makeNode()};
+    auto levels = std::vector<std::vector<int>>(depth);
+    auto leavesCount = 0;
+
+    const auto& bins = histogram.bins();
+    for (auto binIndex = 0; binIndex < static_cast<int>(bins.size()); ++binIndex)
+    {
+        const auto& bin = bins[binIndex];
+        if (bin.count == 0)
+        {
+            continue;
+        }
+
+        const auto red = binIndex >> (2 * depth);
+        const auto green = (binIndex >> depth) & ((1 << depth) - 1);
+        const auto blue = binIndex & ((1 << depth) - 1);
+
+        auto node = 0;
+        for (auto level = 0; level <= depth; ++level)
+        {
+            nodes[node].count += bin.count;
+            nodes[node].red += bin.red;
+            nodes[node].green += bin.green;
+            nodes[node].blue += bin.blue;
+
+            if (level == depth)
+            {
+                nodes[node].isLeaf = true;
+                ++leavesCount;
+                break;
+            }
+
+            const auto bit = depth - level - 1;
+            const auto child = (((red >> bit) & 1) << 2) | (((green >> bit) & 1) << 1) | ((blue >> bit) & 1);
+            if (nodes[node].children[child] == noChild)
+            {
+                if (std::all_of(std::begin(nodes[node].children), std::end(nodes[node].children),
+                                [](const auto index) { return index == noChild; }))
+                {
+                    levels[level].push_back(node);
+                }
+                nodes[node].children[child] = static_cast<int>(nodes.size());
+                nodes.push_back(makeNode());
+            }
+            node = nodes[node].children[child];
+        }
+    }
+
+    // Every deeper level is fully merged before a shallower one is touched, so the children of a merged node are
+    // always leaves.
+    for (auto level = depth - 1; level >= 0 && leavesCount > maximumColorsCount; --level)
+    {
+        auto& levelNodes = levels[level];
+        std::sort(levelNodes.begin(), levelNodes.end(),
+                  [&nodes](const auto lhs, const auto rhs) { return nodes[lhs].count < nodes[rhs].count; });
+
+        for (auto position = levelNodes.cbegin(); position != levelNodes.cend() && leavesCount > maximumColorsCount;
+             ++position)
+        {
+            auto& node = nodes[*position];
+            for (auto& child : node.children)
+            {
+                if (child != noChild)
+                {
+                    --leavesCount;
+                    child = noChild;
+                }
+            }
+            node.isLeaf = true;
+            ++leavesCount;
+        }
+    }
+
+    auto palette = std::vector<Color>{};
+    auto stack = std::vector<int>{0};
+    while (!stack.empty())
+    {
+        const auto& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.isLeaf)
+        {
+            palette.push_back(getAverageColor(node.count, node.red, node.green, node.blue));
+            continue;
+        }
+
+        for (const auto child : node.children)
+        {
+            if (child != noChild)
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+
+    return palette;
+}
+
+IndexedImage getIndexedImage(const Image& image, std::vector<Color> palette)
+{
+    if (static_cast<int>(palette.size()) > IndexedImage::maximumPaletteSize)
+    {
+        THROW(std::invalid_argument, "palette size ", palette.size(), " exceeds the maximum of ",
+              IndexedImage::maximumPaletteSize);
+    }
+
+    auto inversePalette = InversePalette{palette};
+    auto indexes = std::vector<IndexedImage::index_type>(image.size());
+    std::transform(image.cbegin(), image.cend(), indexes.begin(), [&inversePalette](const Color color)
+                   { return static_cast<IndexedImage::index_type>(inversePalette(color)); });
+
+    return IndexedImage{image.width(), image.height(), std::move(palette), std::move(indexes)};
+}
+
+}
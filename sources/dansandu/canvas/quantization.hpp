@@ -0,0 +1,96 @@
+#pragma once
+
+#include "dansandu/canvas/color.hpp"
+#include "dansandu/canvas/image.hpp"
+#include "dansandu/canvas/indexed_image.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace dansandu::canvas::quantization
+{
+
+// Counts colors in 32x32x32 bins, keeping the channel sums of each bin so palettes get the average of the actual
+// colors rather than the bin centers.
+class ColorHistogram
+{
+public:
+    static constexpr auto bitsPerChannel = 5;
+    static constexpr auto binsCount = 1 << (3 * bitsPerChannel);
+
+    struct Bin
+    {
+        uint64_t count;
+        uint64_t red;
+        uint64_t green;
+        uint64_t blue;
+    };
+
+    ColorHistogram() : bins_(binsCount, Bin{0, 0, 0, 0})
+    {
+    }
+
+    static int binIndex(const dansandu::canvas::color::Color color) noexcept
+    {
+        constexpr auto shift = 8 - bitsPerChannel;
+        return ((color.red() >> shift) << (2 * bitsPerChannel)) | ((color.green() >> shift) << bitsPerChannel) |
+               (color.blue() >> shift);
+    }
+
+    void add(const dansandu::canvas::color::Color color, const uint64_t count = 1) noexcept
+    {
+        auto& bin = bins_[binIndex(color)];
+        bin.count += count;
+        bin.red += count * color.red();
+        bin.green += count * color.green();
+        bin.blue += count * color.blue();
+    }
+
+    const std::vector<Bin>& bins() const noexcept
+    {
+        return bins_;
+    }
+
+private:
+    std::vector<Bin> bins_;
+};
+
+// Finds the nearest palette color of a color by the center of its histogram bin. Bins are resolved on first use and
+// cached, so only the bins that actually occur are ever searched.
+class PRALINE_EXPORT InversePalette
+{
+public:
+    explicit InversePalette(std::vector<dansandu::canvas::color::Color> palette);
+
+    int operator()(const dansandu::canvas::color::Color color)
+    {
+        const auto bin = ColorHistogram::binIndex(color);
+        if (lookup_[bin] < 0)
+        {
+            lookup_[bin] = static_cast<int16_t>(findNearest(bin));
+        }
+        return lookup_[bin];
+    }
+
+private:
+    int findNearest(const int bin) const;
+
+    std::vector<dansandu::canvas::color::Color> palette_;
+    std::vector<int16_t> lookup_;
+};
+
+// Splits the color space recursively at the weighted median of the longest axis of the box holding the most spread
+// colors, until there are as many boxes as colors requested.
+PRALINE_EXPORT std::vector<dansandu::canvas::color::Color> getMedianCutPalette(const ColorHistogram& histogram,
+                                                                               const int maximumColorsCount);
+
+// Builds an octree of the histogram bins and merges the least populated deepest nodes until the leaves fit in the
+// requested number of colors.
+PRALINE_EXPORT std::vector<dansandu::canvas::color::Color> getOctreePalette(const ColorHistogram& histogram,
+                                                                            const int maximumColorsCount);
+
+// Maps every pixel through an InversePalette, which gives an image the GIF encoder takes as it is.
+PRALINE_EXPORT dansandu::canvas::indexed_image::IndexedImage
+getIndexedImage(const dansandu::canvas::image::Image& image, std::vector<dansandu::canvas::color::Color> palette);
+
+}
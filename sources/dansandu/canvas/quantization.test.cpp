@@ -0,0 +1,137 @@
+#include "dansandu/canvas/quantization.hpp"
+#include "catchorg/catch/catch.hpp"
+#include "dansandu/canvas/bitmap.hpp"
+#include "dansandu/canvas/color.hpp"
+#include "dansandu/canvas/image.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+using dansandu::canvas::bitmap::readBitmapFile;
+using dansandu::canvas::color::Color;
+using dansandu::canvas::color::Colors;
+using dansandu::canvas::image::Image;
+using dansandu::canvas::quantization::ColorHistogram;
+using dansandu::canvas::quantization::getIndexedImage;
+using dansandu::canvas::quantization::getMedianCutPalette;
+using dansandu::canvas::quantization::getOctreePalette;
+using dansandu::canvas::quantization::InversePalette;
+
+static int getDistance(const Color lhs, const Color rhs)
+{
+    const auto red = lhs.red() - rhs.red();
+    const auto green = lhs.green() - rhs.green();
+    const auto blue = lhs.blue() - rhs.blue();
+    return red * red + green * green + blue * blue;
+}
+
+static double getMeanSquaredError(const Image& image, const std::vector<Color>& palette)
+{
+    auto inversePalette = InversePalette{palette};
+    auto error = 0.0;
+    for (const auto color : image)
+    {
+        error += getDistance(color, palette[inversePalette(color)]);
+    }
+    return error / image.size();
+}
+
+TEST_CASE("quantization")
+{
+    using quantizer_type = std::function<std::vector<Color>(const ColorHistogram&, int)>;
+
+    const auto quantizers = std::vector<quantizer_type>{getMedianCutPalette, getOctreePalette};
+
+    SECTION("few colors are kept exactly")
+    {
+        auto histogram = ColorHistogram{};
+        for (const auto color : {Color{Colors::red}, Color{Colors::green}, Color{Colors::blue}})
+        {
+            for (auto repeat = 0; repeat < 10; ++repeat)
+            {
+                histogram.add(color);
+            }
+        }
+
+        for (const auto& quantizer : quantizers)
+        {
+            auto palette = quantizer(histogram, 256);
+            std::sort(palette.begin(), palette.end(), [](auto lhs, auto rhs) { return lhs.code() < rhs.code(); });
+
+            REQUIRE(palette == std::vector<Color>{Colors::blue, Colors::green, Colors::red});
+        }
+    }
+
+    SECTION("palette size is bounded")
+    {
+        auto histogram = ColorHistogram{};
+        for (auto red = 0; red < 256; red += 4)
+        {
+            for (auto blue = 0; blue < 256; blue += 4)
+            {
+                histogram.add(Color{static_cast<Color::value_type>(red), 0, static_cast<Color::value_type>(blue)});
+            }
+        }
+
+        for (const auto& quantizer : quantizers)
+        {
+            REQUIRE(quantizer(histogram, 1).size() == 1);
+            REQUIRE(quantizer(histogram, 17).size() <= 17);
+            REQUIRE(quantizer(histogram, 256).size() == 256);
+            REQUIRE_THROWS_AS(quantizer(histogram, 0), std::invalid_argument);
+        }
+    }
+
+    SECTION("empty histogram")
+    {
+        for (const auto& quantizer : quantizers)
+        {
+            REQUIRE(quantizer(ColorHistogram{}, 256).empty());
+        }
+    }
+
+    SECTION("inverse palette")
+    {
+        auto inversePalette = InversePalette{{Colors::black, Colors::white, Colors::red}};
+
+        REQUIRE(inversePalette(Color{10, 20, 5}) == 0);
+        REQUIRE(inversePalette(Color{240, 230, 250}) == 1);
+        REQUIRE(inversePalette(Color{200, 40, 30}) == 2);
+        REQUIRE(inversePalette(Color{200, 40, 30}) == 2);
+
+        REQUIRE_THROWS_AS(InversePalette{{}}, std::invalid_argument);
+    }
+
+    SECTION("indexed image")
+    {
+        const auto image = Image{3, 1, {Colors::black, Color{250, 10, 10}, Colors::white}};
+        const auto indexed = getIndexedImage(image, {Colors::white, Colors::red, Colors::black});
+
+        REQUIRE(indexed.width() == 3);
+        REQUIRE(indexed.height() == 1);
+        REQUIRE(indexed.indexes() == std::vector<uint8_t>{2, 1, 0});
+        REQUIRE(indexed.color(1, 0) == Colors::red);
+
+        REQUIRE_THROWS_AS(getIndexedImage(image, std::vector<Color>(257, Colors::black)), std::invalid_argument);
+    }
+
+    SECTION("photographic image")
+    {
+        const auto image = readBitmapFile("resources/dansandu/canvas/expected_flower.bmp");
+
+        auto histogram = ColorHistogram{};
+        for (const auto color : image)
+        {
+            histogram.add(color);
+        }
+
+        for (const auto& quantizer : quantizers)
+        {
+            const auto palette = quantizer(histogram, 256);
+
+            REQUIRE(palette.size() <= 256);
+            REQUIRE(getMeanSquaredError(image, palette) < getMeanSquaredError(image, quantizer(histogram, 16)));
+        }
+    }
+}
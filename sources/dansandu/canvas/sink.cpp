@@ -0,0 +1,137 @@
+#include "dansandu/canvas/sink.hpp"
+#include "dansandu/ballotin/exception.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace dansandu::canvas::sink
+{
+
+void MemorySink::write(const uint8_t* bytes, const size_t count)
+{
+    bytes_.insert(bytes_.end(), bytes, bytes + count);
+}
+
+CallbackSink::CallbackSink(std::function<void(const uint8_t*, size_t)> callback) : callback_{std::move(callback)}
+{
+    if (!callback_)
+    {
+        THROW(std::invalid_argument, "sink callback cannot be empty");
+    }
+}
+
+void CallbackSink::write(const uint8_t* bytes, const size_t count)
+{
+    callback_(bytes, count);
+}
+
+FileDescriptorSink::FileDescriptorSink(const int descriptor) : descriptor_{descriptor}
+{
+    if (descriptor_ < 0)
+    {
+        THROW(std::invalid_argument, "file descriptor ", descriptor_, " is invalid");
+    }
+}
+
+void FileDescriptorSink::write(const uint8_t* bytes, const size_t count)
+{
+    auto written = size_t{0};
+    while (written < count)
+    {
+#ifdef _WIN32
+        const auto result = ::_write(descriptor_, bytes + written, static_cast<unsigned>(count - written));
+#else
+        const auto result = ::write(descriptor_, bytes + written, count - written);
+#endif
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            THROW(std::runtime_error, "failed to write to file descriptor ", descriptor_, ": ", std::strerror(errno));
+        }
+        written += static_cast<size_t>(result);
+    }
+}
+
+FileSink::FileSink(const std::string& path)
+    : path_{path},
+      temporaryPath_{path + ".tmp"},
+      stream_{temporaryPath_, std::ios::binary | std::ios::trunc},
+      committed_{false}
+{
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "could not open file ", temporaryPath_, " for writing");
+    }
+}
+
+FileSink::~FileSink()
+{
+    if (!committed_)
+    {
+        stream_.close();
+        std::remove(temporaryPath_.c_str());
+    }
+}
+
+void FileSink::write(const uint8_t* bytes, const size_t count)
+{
+    if (committed_)
+    {
+        THROW(std::logic_error, "cannot write to committed file ", path_);
+    }
+
+    stream_.write(reinterpret_cast<const char*>(bytes), count);
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "failed to write to file ", temporaryPath_);
+    }
+}
+
+void FileSink::commit()
+{
+    if (committed_)
+    {
+        THROW(std::logic_error, "file ", path_, " is already committed");
+    }
+
+    stream_.close();
+    if (!stream_)
+    {
+        THROW(std::runtime_error, "failed to write to file ", temporaryPath_);
+    }
+
+#ifdef _WIN32
+    const auto renamed = ::MoveFileExA(temporaryPath_.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const auto renamed = std::rename(temporaryPath_.c_str(), path_.c_str()) == 0;
+#endif
+    if (!renamed)
+    {
+        THROW(std::runtime_error, "could not replace file ", path_, " with ", temporaryPath_);
+    }
+    committed_ = true;
+}
+
+SinkBuffer::SinkBuffer(ByteSink& sink, const size_t capacity) : sink_{sink}, capacity_{capacity}
+{
+    bytes_.reserve(capacity_);
+}
+
+void SinkBuffer::flush()
+{
+    sink_.write(bytes_);
+    bytes_.clear();
+}
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dansandu::canvas::sink
+{
+
+// Receives encoded bytes in order as the encoders produce them. Encoders hand over bounded chunks, so a sink never
+// needs to hold the whole binary unless it wants to.
+class PRALINE_EXPORT ByteSink
+{
+public:
+    virtual ~ByteSink() = default;
+
+    virtual void write(const uint8_t* bytes, const size_t count) = 0;
+
+    void write(const std::vector<uint8_t>& bytes)
+    {
+        if (!bytes.empty())
+        {
+            write(bytes.data(), bytes.size());
+        }
+    }
+};
+
+class PRALINE_EXPORT MemorySink : public ByteSink
+{
+public:
+    using ByteSink::write;
+
+    void write(const uint8_t* bytes, const size_t count) override;
+
+    const std::vector<uint8_t>& bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+    std::vector<uint8_t> release() noexcept
+    {
+        return std::move(bytes_);
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+};
+
+class PRALINE_EXPORT CallbackSink : public ByteSink
+{
+public:
+    using ByteSink::write;
+
+    explicit CallbackSink(std::function<void(const uint8_t*, size_t)> callback);
+
+    void write(const uint8_t* bytes, const size_t count) override;
+
+private:
+    std::function<void(const uint8_t*, size_t)> callback_;
+};
+
+// Writes to a file descriptor such as a socket or a pipe, retrying partial and interrupted writes. The descriptor
+// stays owned by the caller.
+class PRALINE_EXPORT FileDescriptorSink : public ByteSink
+{
+public:
+    using ByteSink::write;
+
+    explicit FileDescriptorSink(const int descriptor);
+
+    void write(const uint8_t* bytes, const size_t count) override;
+
+private:
+    int descriptor_;
+};
+
+// Writes to a temporary file next to the path and only replaces the file on commit, so a failed write leaves any
+// existing file untouched. The temporary file is removed if the sink is destroyed before it is committed.
+class PRALINE_EXPORT FileSink : public ByteSink
+{
+public:
+    using ByteSink::write;
+
+    explicit FileSink(const std::string& path);
+
+    FileSink(const FileSink&) = delete;
+
+    FileSink& operator=(const FileSink&) = delete;
+
+    ~FileSink() override;
+
+    void write(const uint8_t* bytes, const size_t count) override;
+
+    void commit();
+
+private:
+    std::string path_;
+    std::string temporaryPath_;
+    std::ofstream stream_;
+    bool committed_;
+};
+
+// Collects small writes and hands them to the sink in chunks of at least the given size.
+class PRALINE_EXPORT SinkBuffer
+{
+public:
+    static constexpr size_t defaultCapacity = 1 << 16;
+
+    explicit SinkBuffer(ByteSink& sink, const size_t capacity = defaultCapacity);
+
+    std::vector<uint8_t>& bytes() noexcept
+    {
+        return bytes_;
+    }
+
+    void flushIfFull()
+    {
+        if (bytes_.size() >= capacity_)
+        {
+            flush();
+        }
+    }
+
+    void flush();
+
+private:
+    ByteSink& sink_;
+    size_t capacity_;
+    std::vector<uint8_t> bytes_;
+};
+
+}
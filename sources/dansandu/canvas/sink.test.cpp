@@ -0,0 +1,107 @@
+#include "dansandu/canvas/sink.hpp"
+#include "catchorg/catch/catch.hpp"
+#include "dansandu/ballotin/file_system.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using dansandu::ballotin::file_system::readBinaryFile;
+using dansandu::ballotin::file_system::writeBinaryFile;
+using dansandu::canvas::sink::CallbackSink;
+using dansandu::canvas::sink::FileDescriptorSink;
+using dansandu::canvas::sink::FileSink;
+using dansandu::canvas::sink::MemorySink;
+using dansandu::canvas::sink::SinkBuffer;
+
+TEST_CASE("sink")
+{
+    const auto bytes = std::vector<uint8_t>{1, 2, 3, 4, 5};
+
+    SECTION("memory")
+    {
+        auto sink = MemorySink{};
+        sink.write(bytes.data(), 2);
+        sink.write(bytes.data() + 2, 3);
+
+        REQUIRE(sink.bytes() == bytes);
+        REQUIRE(sink.release() == bytes);
+    }
+
+    SECTION("callback")
+    {
+        auto chunks = std::vector<std::vector<uint8_t>>{};
+        auto sink = CallbackSink{[&chunks](const uint8_t* data, const size_t count)
+                                 { chunks.emplace_back(data, data + count); }};
+        sink.write(bytes);
+        sink.write(std::vector<uint8_t>{});
+
+        REQUIRE(chunks == std::vector<std::vector<uint8_t>>{bytes});
+    }
+
+    SECTION("file descriptor")
+    {
+        const auto file = std::tmpfile();
+        REQUIRE(file);
+
+        auto sink = FileDescriptorSink{fileno(file)};
+        sink.write(bytes);
+
+        std::rewind(file);
+        auto actual = std::vector<uint8_t>(bytes.size() + 1);
+        const auto readCount = std::fread(actual.data(), 1, actual.size(), file);
+        std::fclose(file);
+
+        actual.resize(readCount);
+        REQUIRE(actual == bytes);
+
+        REQUIRE_THROWS_AS(FileDescriptorSink{-1}, std::invalid_argument);
+    }
+
+    SECTION("file")
+    {
+        const auto path = std::string{"target/actual_sink.bin"};
+        const auto previous = std::vector<uint8_t>{9, 9};
+        writeBinaryFile(path, previous);
+
+        SECTION("commit")
+        {
+            auto sink = FileSink{path};
+            sink.write(bytes);
+            REQUIRE(readBinaryFile(path) == previous);
+
+            sink.commit();
+            REQUIRE(readBinaryFile(path) == bytes);
+            REQUIRE(!std::ifstream{path + ".tmp"});
+            REQUIRE_THROWS_AS(sink.write(bytes), std::logic_error);
+        }
+
+        SECTION("destroyed before commit")
+        {
+            {
+                auto sink = FileSink{path};
+                sink.write(bytes);
+            }
+
+            REQUIRE(readBinaryFile(path) == previous);
+            REQUIRE(!std::ifstream{path + ".tmp"});
+        }
+    }
+
+    SECTION("buffer")
+    {
+        auto sink = MemorySink{};
+        auto buffer = SinkBuffer{sink, 4};
+
+        buffer.bytes().insert(buffer.bytes().end(), bytes.cbegin(), bytes.cbegin() + 3);
+        buffer.flushIfFull();
+        REQUIRE(sink.bytes().empty());
+
+        buffer.bytes().insert(buffer.bytes().end(), bytes.cbegin() + 3, bytes.cend());
+        buffer.flushIfFull();
+        REQUIRE(sink.bytes() == bytes);
+        REQUIRE(buffer.bytes().empty());
+    }
+}